@@ -0,0 +1,212 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "arena.h"
+#include "exceptions.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+// The size of a huge page on x86-64 and of the alignment of the mappings,
+// so that transparent huge pages can back them from their first byte.
+std::size_t const huge_page = std::size_t(2) << 20;
+
+__thread Arena* current_arena = 0;
+
+}
+
+std::size_t const Arena::alignment;
+
+bool is_huge_pages (std::string const& name) {
+    return name == "none" || name == "transparent" || name == "explicit";
+}
+
+Arena::Arena (std::string const& huge_pages, std::size_t chunk_size)
+    : huge_pages_(huge_pages), fallback_(false), discard_(false), chunk_size_(chunk_size), in_use_(0), peak_(0), mapped_(0)
+{
+    if (!is_huge_pages(huge_pages))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("huge pages " + huge_pages + " is not none, transparent or explicit"));
+}
+
+Arena::~Arena () {
+    for (std::size_t i = 0; i < chunks_.size(); ++i) {
+        munmap(chunks_[i].base, chunks_[i].size);
+    }
+}
+
+void* Arena::allocate (std::size_t bytes) {
+    bytes = std::max<std::size_t>((bytes + alignment - 1)/alignment*alignment, alignment);
+    boost::mutex::scoped_lock lock(mutex_);
+    for (std::size_t c = 0; ; ++c) {
+        if (c == chunks_.size()) {
+            map_chunk(bytes);
+        }
+        std::map<std::size_t, std::size_t>& free = chunks_[c].free;
+        for (std::map<std::size_t, std::size_t>::iterator it = free.begin(); it != free.end(); ++it) {
+            if (it->second < bytes) {
+                continue;
+            }
+            std::size_t offset = it->first;
+            std::size_t rest = it->second - bytes;
+            free.erase(it);
+            if (rest > 0) {
+                free[offset + bytes] = rest;
+            }
+            char* ptr = chunks_[c].base + offset;
+            blocks_[ptr] = std::make_pair(c, bytes);
+            in_use_ += bytes;
+            peak_ = std::max(peak_, in_use_);
+            return ptr;
+        }
+    }
+}
+
+void Arena::deallocate (void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    std::map<char*, std::pair<std::size_t, std::size_t> >::iterator block = blocks_.find(static_cast<char*>(ptr));
+    if (block == blocks_.end()) {
+        // A block of another arena or the heap; it is called from the
+        // destructors of the fields, so it cannot throw.
+        std::cerr << "Arena::deallocate: " << ptr << " was not allocated from this arena" << std::endl;
+        std::abort();
+    }
+    Chunk& chunk = chunks_[block->second.first];
+    std::size_t offset = block->first - chunk.base;
+    std::size_t size = block->second.second;
+    blocks_.erase(block);
+    in_use_ -= size;
+
+    std::map<std::size_t, std::size_t>::iterator next = chunk.free.lower_bound(offset);
+    if (next != chunk.free.end() && next->first == offset + size) {
+        size += next->second;
+        chunk.free.erase(next++);
+    }
+    if (next != chunk.free.begin()) {
+        std::map<std::size_t, std::size_t>::iterator previous = next;
+        --previous;
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            offset = previous->first;
+            size = previous->second;
+        } else {
+            chunk.free[offset] = size;
+        }
+    } else {
+        chunk.free[offset] = size;
+    }
+    if (discard_) {
+        // Only the pages that the free block covers whole; those of
+        // explicit huge pages are discarded whole huge pages at a time.
+        std::size_t page = chunk.hugetlb ? huge_page : std::size_t(sysconf(_SC_PAGESIZE));
+        std::size_t first = (offset + page - 1)/page*page;
+        std::size_t last = (offset + size)/page*page;
+        if (last > first) {
+            madvise(chunk.base + first, last - first, MADV_DONTNEED);
+        }
+    }
+}
+
+void Arena::set_discard (bool discard) {
+    boost::mutex::scoped_lock lock(mutex_);
+    discard_ = discard;
+}
+
+std::size_t Arena::in_use () const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return in_use_;
+}
+
+std::size_t Arena::peak () const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return peak_;
+}
+
+std::size_t Arena::mapped () const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return mapped_;
+}
+
+void Arena::reset_peak () {
+    boost::mutex::scoped_lock lock(mutex_);
+    peak_ = in_use_;
+}
+
+// Maps a chunk of at least bytes bytes, a multiple of the huge page. The
+// pages of a new mapping are only faulted in when a field touches them
+// first, so the threads that zero a field place its pages on their nodes.
+// A block that is reused keeps the pages where they were first touched,
+// unless the arena discards the pages of released blocks.
+void Arena::map_chunk (std::size_t bytes) {
+    std::size_t size = (std::max(bytes, chunk_size_) + huge_page - 1)/huge_page*huge_page;
+    void* ptr = MAP_FAILED;
+    if (huge_pages_ == "explicit" && !fallback_) {
+        ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        fallback_ = (ptr == MAP_FAILED);
+    }
+    if (ptr == MAP_FAILED) {
+        // Mapped with a huge page to spare and trimmed to a huge page
+        // boundary.
+        char* raw = static_cast<char*>(mmap(0, size + huge_page, PROT_READ | PROT_WRITE,
+                                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw == MAP_FAILED)
+            BOOST_THROW_EXCEPTION(out_of_memory_error());
+        char* base = raw + (huge_page - reinterpret_cast<std::size_t>(raw) % huge_page) % huge_page;
+        if (base > raw) {
+            munmap(raw, base - raw);
+        }
+        munmap(base + size, raw + huge_page - base);
+        if (huge_pages_ != "none") {
+            madvise(base, size, MADV_HUGEPAGE);
+        }
+        ptr = base;
+    }
+    Chunk chunk;
+    chunk.hugetlb = !fallback_ && huge_pages_ == "explicit";
+    chunk.base = static_cast<char*>(ptr);
+    chunk.size = size;
+    chunk.free[0] = size;
+    chunks_.push_back(chunk);
+    mapped_ += size;
+}
+
+Arena::Scope::Scope (Arena* arena)
+    : previous_(current_arena)
+{
+    current_arena = arena;
+}
+
+Arena::Scope::~Scope () {
+    current_arena = previous_;
+}
+
+Arena* Arena::current () {
+    return current_arena;
+}
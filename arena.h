@@ -0,0 +1,117 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#ifndef __ARENA_H_INCLUDED__
+#define __ARENA_H_INCLUDED__ 
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Memory of the fields of one job, carved out of a few large mappings that
+// are kept until the arena is destroyed, so that a job that follows another
+// one reuses the pages of its fields without unmapping and faulting them in
+// again. The mappings may be backed by huge pages, which cover a field with
+// far fewer TLB entries than pages of 4 KiB: "transparent" asks the kernel to
+// back them by huge pages where it can, "explicit" takes them from the pool
+// of huge pages reserved by the administrator and falls back to transparent
+// ones when the pool is too small. Blocks are handed out first fit and
+// merged with their free neighbours when released. Allocation and release
+// are safe from any thread.
+//
+// The pages of a reused block stay on the NUMA node of the thread that
+// touched them first, e.g., in the job before, which defeats the placement
+// of the fields by their first touch. With set_discard the pages of
+// released blocks are given back to the kernel instead, and the next field
+// placed there is faulted in afresh by the threads that zero it.
+///////////////////////////////////////////////////////////////////////////////
+
+class Arena : boost::noncopyable {
+public:
+    static std::size_t const alignment = 64;
+
+    // chunk_size is the smallest size of a mapping; larger blocks get a
+    // mapping of their own.
+    explicit Arena (std::string const& huge_pages = "none", std::size_t chunk_size = std::size_t(64) << 20);
+    ~Arena ();
+
+    // Returns a block of at least bytes bytes aligned to alignment; throws
+    // out_of_memory_error if no mapping can be made.
+    void* allocate (std::size_t bytes);
+    // Releases a block of allocate; aborts on a pointer that is not one.
+    void deallocate (void* ptr);
+    // Whether deallocate discards the whole pages of the free blocks.
+    void set_discard (bool discard);
+
+    std::string const& huge_pages () const { return huge_pages_; }
+    // Whether explicit huge pages were asked for but not available.
+    bool huge_pages_fallback () const { return fallback_; }
+
+    // Bytes in the blocks in use, their maximum since the last reset_peak
+    // and the bytes mapped.
+    std::size_t in_use () const;
+    std::size_t peak () const;
+    std::size_t mapped () const;
+    void reset_peak ();
+
+    // Allocations of the fields (Field::resize) made by the calling thread
+    // while a scope is alive come from the arena of the scope; without a
+    // scope, or with a null arena, they come from the heap. Scopes nest.
+    class Scope : boost::noncopyable {
+    public:
+        explicit Scope (Arena* arena);
+        ~Scope ();
+    private:
+        Arena* previous_;
+    };
+    static Arena* current ();
+
+private:
+    struct Chunk {
+        bool hugetlb;           // of explicit huge pages
+        char* base;
+        std::size_t size;
+        std::map<std::size_t, std::size_t> free;    // offset -> size
+    };
+
+    void map_chunk (std::size_t bytes);
+
+    std::string huge_pages_;
+    bool fallback_;
+    bool discard_;
+    std::size_t chunk_size_;
+    std::vector<Chunk> chunks_;
+    std::map<char*, std::pair<std::size_t, std::size_t> > blocks_;  // -> chunk, size
+    std::size_t in_use_, peak_, mapped_;
+    mutable boost::mutex mutex_;
+};
+
+// Returns whether name is a choice of huge pages: none, transparent or
+// explicit.
+bool is_huge_pages (std::string const& name);
+
+#endif /* __ARENA_H_INCLUDED__ */
@@ -19,62 +19,477 @@
 //  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 //  IN THE SOFTWARE.
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "array.h"
+#include "utils.h"
 
+#include <algorithm>
 #include <cmath>
 
-void convolve (array_t const& a, std::vector<double> const& k, array_t& result) {
-    array_t b(a);
-    int size_x = a.shape()[0];
-    int size_y = a.shape()[1];
-    int k_size = k.size();
-    int k_center = k_size/2;
-    for (int jy = 0; jy != size_y; ++jy) {
-        for (int jx = k_center; jx != size_x - k_center; ++jx) {
+namespace {
+
+// Returns the pixel that i mirrors to in [0, size), the way the halo of a
+// Field mirrors -1 to 1 and size to size-2, also for i farther outside.
+int reflect (int i, int size) {
+    if (size == 1) {
+        return 0;
+    }
+    int period = 2*(size - 1);
+    i %= period;
+    if (i < 0) {
+        i += period;
+    }
+    return (i < size) ? i : period - i;
+}
+
+// Columns of a block that convolve_rows filters at a time. The rows of the
+// block that the kernel spans stay in the cache while the block moves down
+// the image.
+int const block_width = 512;
+
+// out[x] = sum of k[i]*in[i][x] for x in [0, n). With the kernel size K
+// known at compile time the sum over i is unrolled and the loop over x is
+// vectorized; otherwise the terms are accumulated four inputs at a time so
+// that the loop over x vectorizes as well. Both add the terms in the same
+// order.
+template <int K, typename T>
+void weighted_sum (T const* const* in, double const* k, int k_size, int n, double* __restrict__ out) {
+    if (K > 0) {
+        T const* r[(K > 0) ? K : 1];
+        double kk[(K > 0) ? K : 1];
+        for (int i = 0; i < K; ++i) {
+            r[i] = in[i];
+            kk[i] = k[i];
+        }
+        for (int x = 0; x < n; ++x) {
             double sum = 0.0;
-            for (int xi = 0; xi != k_size; ++xi) {
-                int xx = jx + xi - k_center;
-                sum += a[xx][jy] * k[xi];
+            for (int i = 0; i < K; ++i) {
+                sum += kk[i]*r[i][x];
+            }
+            out[x] = sum;
+        }
+    } else {
+        std::fill(out, out + n, 0.0);
+        int i = 0;
+        for (; i + 4 <= k_size; i += 4) {
+            T const* r0 = in[i];
+            T const* r1 = in[i+1];
+            T const* r2 = in[i+2];
+            T const* r3 = in[i+3];
+            double k0 = k[i], k1 = k[i+1], k2 = k[i+2], k3 = k[i+3];
+            for (int x = 0; x < n; ++x) {
+                double sum = out[x];
+                sum += k0*r0[x];
+                sum += k1*r1[x];
+                sum += k2*r2[x];
+                sum += k3*r3[x];
+                out[x] = sum;
+            }
+        }
+        for (; i < k_size; ++i) {
+            T const* r = in[i];
+            double ki = k[i];
+            for (int x = 0; x < n; ++x) {
+                out[x] += ki*r[x];
             }
-            b[jx][jy] = sum;
         }
     }
-    for (int jy = k_center; jy != size_y - k_center; ++jy) {
-        for (int jx = 0; jx != size_x; ++jx) {
-            double sum = 0.0;
-            for (int yi = 0; yi != k_size; ++yi) {
-                int yy = jy + yi - k_center;
-                sum += b[jx][yy] * k[yi];
+}
+
+// Convolves the rows y_start to y_end-1 of a with the kernel k of radius R,
+// or k.size()/2 if R is 0, in blocks of columns. For every row the columns
+// of the block and R more on each side are filtered vertically into line,
+// with the columns beyond the boundary mirrored from those inside, and line
+// is then filtered horizontally into result.
+template <int R, typename T>
+void convolve_rows (Field<T> const& a, std::vector<double> const& k, Field<T>& result, int y_start, int y_end) {
+    int r = (R > 0) ? R : int(k.size())/2;
+    int k_size = 2*r + 1;
+    int size_x = a.size_x();
+    int size_y = a.size_y();
+    std::vector<double const*> shifted(k_size);
+    std::vector<T const*> rows(k_size);
+    std::vector<double> line(block_width + 2*r);
+    std::vector<double> out(block_width);
+    for (int i = 0; i < k_size; ++i) {
+        shifted[i] = &line[i];
+    }
+    for (int x0 = 0; x0 < size_x; x0 += block_width) {
+        int x1 = std::min(x0 + block_width, size_x);
+        int first = x0 - r;
+        int lo = std::max(first, 0);
+        int hi = std::min(x1 + r, size_x);
+        for (int y = y_start; y < y_end; ++y) {
+            for (int i = 0; i < k_size; ++i) {
+                rows[i] = a.row(reflect(y + i - r, size_y)) + lo;
+            }
+            weighted_sum<(R > 0) ? 2*R + 1 : 0>(&rows[0], &k[0], k_size, hi - lo, &line[lo - first]);
+            for (int x = first; x < lo; ++x) {
+                line[x - first] = line[reflect(x, size_x) - first];
+            }
+            for (int x = hi; x < x1 + r; ++x) {
+                line[x - first] = line[reflect(x, size_x) - first];
             }
-            result[jx][jy] = sum;
+            weighted_sum<(R > 0) ? 2*R + 1 : 0>(&shifted[0], &k[0], k_size, x1 - x0, &out[0]);
+            std::copy(out.begin(), out.begin() + (x1 - x0), result.row(y) + x0);
         }
     }
 }
 
-void compute_gradient (array_t const& src, array_t& dx, array_t& dy, array_t& norm_grad, double h, int y_start, int y_end) {
-    int size_x = src.shape()[0];
-    int size_y = src.shape()[1];
-    for (int y = y_start; y < y_end; y++) {
-        for (int x = 0; x < size_x-1; x++) {
-            dx[x][y] = (src[x+1][y] - src[x][y])/h;
+}
+
+// The image is split into blocks of rows among the threads of a team of its
+// own. Kernels of radius up to 8, which cover sigma up to about 2.5 h, are
+// compiled with the radius as a constant.
+template <typename T>
+void convolve (Field<T> const& a, std::vector<double> const& k, Field<T>& result) {
+    result.resize(a.size_x(), a.size_y());
+#pragma omp parallel default(shared)
+    {
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+#else
+        int tid = 0;
+        int nthreads = 1;
+#endif
+        int y_start, y_end;
+        split_rows(a.size_y(), tid, nthreads, y_start, y_end);
+        switch (k.size()/2) {
+        case 1:  convolve_rows<1>(a, k, result, y_start, y_end); break;
+        case 2:  convolve_rows<2>(a, k, result, y_start, y_end); break;
+        case 3:  convolve_rows<3>(a, k, result, y_start, y_end); break;
+        case 4:  convolve_rows<4>(a, k, result, y_start, y_end); break;
+        case 5:  convolve_rows<5>(a, k, result, y_start, y_end); break;
+        case 6:  convolve_rows<6>(a, k, result, y_start, y_end); break;
+        case 7:  convolve_rows<7>(a, k, result, y_start, y_end); break;
+        case 8:  convolve_rows<8>(a, k, result, y_start, y_end); break;
+        default: convolve_rows<0>(a, k, result, y_start, y_end); break;
         }
     }
-    for (int y = y_start; y < y_end-1; y++) {
+}
+
+namespace {
+
+// Coefficients of the fourth-order recursive approximation of a Gaussian
+// of standard deviation sigma pixels by R. Deriche, Recursively
+// implementing the Gaussian and its derivatives, INRIA research report
+// 1893 (1993). A line x is filtered into the sum of a causal part
+// c[i] = n0*x[i] + ... + n3*x[i-3] - d1*c[i-1] - ... - d4*c[i-4] and of an
+// anticausal part a[i] = m1*x[i+1] + ... + m4*x[i+4] - d1*a[i+1] - ... -
+// d4*a[i+4]. The numerators are scaled so that a constant is preserved.
+struct Deriche_gaussian {
+    explicit Deriche_gaussian (double sigma) {
+        double const a1 = 1.3530, b1 = 1.8151, w1 = 0.6681, l1 = -1.3932;
+        double const a2 = -0.3531, b2 = 0.0902, w2 = 2.0787, l2 = -1.3732;
+        double s1 = std::sin(w1/sigma), c1 = std::cos(w1/sigma), e1 = std::exp(l1/sigma);
+        double s2 = std::sin(w2/sigma), c2 = std::cos(w2/sigma), e2 = std::exp(l2/sigma);
+        n0 = a1 + a2;
+        n1 = e2*(b2*s2 - (a2 + 2*a1)*c2) + e1*(b1*s1 - (a1 + 2*a2)*c1);
+        n2 = 2*e1*e2*((a1 + a2)*c1*c2 - b1*c2*s1 - b2*c1*s2) + a2*e1*e1 + a1*e2*e2;
+        n3 = e1*e2*e2*(b1*s1 - a1*c1) + e1*e1*e2*(b2*s2 - a2*c2);
+        d1 = -2*(e1*c1 + e2*c2);
+        d2 = 4*c1*c2*e1*e2 + e1*e1 + e2*e2;
+        d3 = -2*e1*e2*(c1*e2 + c2*e1);
+        d4 = e1*e1*e2*e2;
+        m1 = n1 - d1*n0;
+        m2 = n2 - d2*n0;
+        m3 = n3 - d3*n0;
+        m4 = -d4*n0;
+        double sum_n = n0 + n1 + n2 + n3;
+        double sum_m = m1 + m2 + m3 + m4;
+        double sum_d = 1.0 + d1 + d2 + d3 + d4;
+        double gain = (sum_n + sum_m)/sum_d;
+        n0 /= gain; n1 /= gain; n2 /= gain; n3 /= gain;
+        m1 /= gain; m2 /= gain; m3 /= gain; m4 /= gain;
+        causal_gain = sum_n/gain/sum_d;
+        // The poles decay by exp(-1.37/sigma) per pixel, so the part of
+        // the response that depends on how a pass starts has fallen below
+        // 1e-4 of the start value after 7 sigma.
+        pad = int(std::ceil(7.0*sigma)) + 4;
+    }
+
+    // Filters width interleaved lines of n values, x[j][0] to
+    // x[j][width-1] for j from 0 to n - 1, whose values x[-4] to x[-1] and
+    // x[n] to x[n+3] have to repeat the first and the last one. Each part
+    // starts in the steady state of the value it starts from. Only the
+    // values from pad to n - pad - 1 are stored, into y[j - pad]; causal
+    // holds n + 4 and last 8 rows of width values. The loops over the lines
+    // vectorize.
+    void filter (double const* const* x, int n, int width, double* causal, double* last, double* y) const {
+        double* c = causal + 4*width;
+        for (int j = -4; j < 0; ++j) {
+            double* w = c + j*width;
+            for (int i = 0; i < width; ++i) {
+                w[i] = causal_gain*x[0][i];
+            }
+        }
+        for (int j = 0; j < n; ++j) {
+            double* w = c + j*width;
+            double const* x0 = x[j];
+            double const* x1 = x[j-1];
+            double const* x2 = x[j-2];
+            double const* x3 = x[j-3];
+            for (int i = 0; i < width; ++i) {
+                w[i] = n0*x0[i] + n1*x1[i] + n2*x2[i] + n3*x3[i]
+                     - d1*w[i - width] - d2*w[i - 2*width] - d3*w[i - 3*width] - d4*w[i - 4*width];
+            }
+        }
+        for (int j = n; j < n + 4; ++j) {
+            double* e = last + (j & 7)*width;
+            for (int i = 0; i < width; ++i) {
+                e[i] = (1.0 - causal_gain)*x[n-1][i];
+            }
+        }
+        for (int j = n - 1; j >= pad; --j) {
+            double* e = last + (j & 7)*width;
+            double const* e1 = last + ((j + 1) & 7)*width;
+            double const* e2 = last + ((j + 2) & 7)*width;
+            double const* e3 = last + ((j + 3) & 7)*width;
+            double const* e4 = last + ((j + 4) & 7)*width;
+            double const* x1 = x[j+1];
+            double const* x2 = x[j+2];
+            double const* x3 = x[j+3];
+            double const* x4 = x[j+4];
+            for (int i = 0; i < width; ++i) {
+                e[i] = m1*x1[i] + m2*x2[i] + m3*x3[i] + m4*x4[i]
+                     - d1*e1[i] - d2*e2[i] - d3*e3[i] - d4*e4[i];
+            }
+            if (j < n - pad) {
+                double const* w = c + j*width;
+                double* out = y + (j - pad)*width;
+                for (int i = 0; i < width; ++i) {
+                    out[i] = w[i] + e[i];
+                }
+            }
+        }
+    }
+
+    double n0, n1, n2, n3;      // of the causal part
+    double m1, m2, m3, m4;      // of the anticausal part
+    double d1, d2, d3, d4;      // of both
+    double causal_gain;         // of the causal part for a constant
+    int pad;                    // mirrored pixels on each side of a line
+};
+
+// Columns that the vertical pass of recursive_gaussian filters together,
+// and rows that its horizontal pass filters together.
+int const strip_width = 256;
+int const row_group = 8;
+
+}
+
+// Both passes run over lines of the image mirrored by pad pixels on each
+// side. The horizontal pass transposes groups of rows so that, like the
+// vertical one, it filters several lines with each step of the recursion.
+template <typename T>
+void recursive_gaussian (Field<T> const& a, double sigma, Field<T>& result) {
+    Deriche_gaussian g(sigma);
+    int size_x = a.size_x();
+    int size_y = a.size_y();
+    Field<double> rows(size_x, size_y);
+    result.resize(size_x, size_y);
+#pragma omp parallel default(shared)
+    {
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+#else
+        int tid = 0;
+        int nthreads = 1;
+#endif
+        int start, end;
+        split_rows(size_y, tid, nthreads, start, end);
+        int n = size_x + 2*g.pad;
+        std::vector<double> group(n*row_group), filtered(size_x*row_group);
+        std::vector<double> causal((n + 4)*row_group), last(8*row_group);
+        std::vector<double const*> lines(n + 8);
+        for (int y0 = start; y0 < end; y0 += row_group) {
+            int width = std::min(row_group, end - y0);
+            for (int k = 0; k < width; ++k) {
+                T const* ar = a.row(y0 + k);
+                for (int j = 0; j < n; ++j) {
+                    group[j*width + k] = ar[reflect(j - g.pad, size_x)];
+                }
+            }
+            for (int j = -4; j < n + 4; ++j) {
+                lines[j + 4] = &group[std::min(std::max(j, 0), n - 1)*width];
+            }
+            g.filter(&lines[4], n, width, &causal[0], &last[0], &filtered[0]);
+            for (int k = 0; k < width; ++k) {
+                double* r = rows.row(y0 + k);
+                for (int x = 0; x < size_x; ++x) {
+                    r[x] = filtered[x*width + k];
+                }
+            }
+        }
+#pragma omp barrier
+        split_rows(size_x, tid, nthreads, start, end);
+        n = size_y + 2*g.pad;
+        std::vector<double> strip(size_y*strip_width);
+        causal.resize((n + 4)*strip_width);
+        last.resize(8*strip_width);
+        lines.resize(n + 8);
+        for (int x0 = start; x0 < end; x0 += strip_width) {
+            int width = std::min(strip_width, end - x0);
+            for (int j = -4; j < n + 4; ++j) {
+                lines[j + 4] = rows.row(reflect(std::min(std::max(j, 0), n - 1) - g.pad, size_y)) + x0;
+            }
+            g.filter(&lines[4], n, width, &causal[0], &last[0], &strip[0]);
+            for (int y = 0; y < size_y; ++y) {
+                std::copy(&strip[y*width], &strip[y*width] + width, result.row(y) + x0);
+            }
+        }
+    }
+}
+
+template <typename T>
+void gaussian_smooth (Field<T> const& a, double sigma, double h, Field<T>& result, std::string const& method) {
+    std::vector<double> kernel = create_kernel(sigma, h);
+    bool recursive = (method == "recursive") || (method == "auto" && int(kernel.size()) > recursive_kernel_size);
+    if (recursive && sigma/h >= 0.5) {
+        recursive_gaussian(a, sigma/h, result);
+    } else {
+        convolve(a, kernel, result);
+    }
+}
+
+// The halo of src has to be valid. dx and dy are the forward differences,
+// dx(x,y) = (src(x+1,y) - src(x,y))/h, which are computed also in the ghost
+// column x = -1 and in the ghost row y = -1 so that the norm of the gradient
+// needs no special treatment of the boundary. Because the halo mirrors the
+// values next to the boundary, the differences there only change their sign.
+template <typename T>
+void compute_gradient (Field<T> const& src, Field<T>& dx, Field<T>& dy, Field<T>& norm_grad, double h, int y_start, int y_end) {
+    int size_x = src.size_x();
+    for (int y = (y_start == 0) ? -1 : y_start; y < y_end; y++) {
+        T const* s  = src.row(y);
+        T const* su = src.row(y+1);
+        T* ddx = dx.row(y);
+        T* ddy = dy.row(y);
+        for (int x = -1; x < size_x; x++) {
+            ddx[x] = (s[x+1] - s[x])/h;
+        }
         for (int x = 0; x < size_x; x++) {
-            dy[x][y] = (src[x][y+1] - src[x][y])/h;
+            ddy[x] = (su[x] - s[x])/h;
         }
     }
+#pragma omp barrier
     for (int y = y_start; y < y_end; y++) {
+        T const* ddx = dx.row(y);
+        T const* ddy = dy.row(y);
+        T const* ddyd = dy.row(y-1);
+        T* ng = norm_grad.row(y);
         for (int x = 0; x < size_x; x++) {
-            double r = (x == size_x-1) ? dx[size_x-2][y] : dx[x][y];
-            double l = (x == 0)        ? dx[0][y]        : dx[x-1][y];
-            double u = (y == size_y-1) ? dy[x][size_y-2] : dy[x][y];
-            double d = (y == 0)        ? dy[x][0]        : dy[x][y-1];
-            norm_grad[x][y] = std::sqrt(0.5*(r*r+l*l+u*u+d*d));
+            double r = ddx[x];
+            double l = ddx[x-1];
+            double u = ddy[x];
+            double d = ddyd[x];
+            ng[x] = std::sqrt(0.5*(r*r+l*l+u*u+d*d));
         }
     }
 }
 
+template <typename T>
+void compute_gradient_norm (Field<T> const& src, Field<T>& norm_grad, double h, int y, int x_begin, int x_end) {
+    T const* s  = src.row(y);
+    T const* su = src.row(y+1);
+    T const* sd = src.row(y-1);
+    T* ng = norm_grad.row(y);
+    for (int x = x_begin; x < x_end; x++) {
+        double r = T((s[x+1] - s[x])/h);
+        double l = T((s[x] - s[x-1])/h);
+        double u = T((su[x] - s[x])/h);
+        double d = T((s[x] - sd[x])/h);
+        ng[x] = std::sqrt(0.5*(r*r+l*l+u*u+d*d));
+    }
+}
+
+template <typename T>
+void start_step (Field<T> const& p_old, Field<T>& p, Field<T>& norm_grad, double w, double h, int y_start, int y_end) {
+    int size_x = p_old.size_x();
+    int size_y = p_old.size_y();
+    for (int y = (y_start == 0) ? -1 : y_start; y < y_end + (y_end == size_y); y++) {
+        T const* s  = p_old.row(y);
+        T* guess = p.row(y);
+        for (int x = -1; x <= size_x; x++) {
+            guess[x] = s[x] + w*(s[x] - guess[x]);
+        }
+        if (y < 0 || y == size_y) {
+            continue;
+        }
+        T const* su = p_old.row(y+1);
+        T const* sd = p_old.row(y-1);
+        T* ng = norm_grad.row(y);
+        for (int x = 0; x < size_x; x++) {
+            double r = T((s[x+1] - s[x])/h);
+            double l = T((s[x] - s[x-1])/h);
+            double u = T((su[x] - s[x])/h);
+            double d = T((s[x] - sd[x])/h);
+            ng[x] = std::sqrt(0.5*(r*r+l*l+u*u+d*d));
+        }
+    }
+}
+
+template <typename T>
+void coarsen (Field<T> const& fine, Field<T>& coarse) {
+    int size_x = fine.size_x();
+    int size_y = fine.size_y();
+    coarse.resize((size_x + 1)/2, (size_y + 1)/2);
+    for (int J = 0; J < coarse.size_y(); ++J) {
+        T const* f0 = fine.row(2*J);
+        T const* f1 = fine.row(std::min(2*J + 1, size_y - 1));
+        T* c = coarse.row(J);
+        for (int I = 0; I < coarse.size_x(); ++I) {
+            int x0 = 2*I, x1 = std::min(2*I + 1, size_x - 1);
+            c[I] = 0.25*(f0[x0] + f0[x1] + f1[x0] + f1[x1]);
+        }
+    }
+    coarse.reflect_halo(0, coarse.size_y());
+}
+
+// The pixel x of fine lies a quarter of a coarse pixel from the centre of
+// x/2 towards that of x/2 - 1 or x/2 + 1, so it gets the weights 3/4 and 1/4
+// in each direction; beyond the boundary the values next to it are repeated.
+template <typename T>
+void interpolate (Field<T> const& coarse, Field<T>& fine) {
+    int nx = coarse.size_x();
+    int ny = coarse.size_y();
+    for (int y = 0; y < fine.size_y(); ++y) {
+        int J = y/2;
+        int JJ = std::max(0, std::min((y % 2 == 0) ? J-1 : J+1, ny-1));
+        T const* cn  = coarse.row(J);
+        T const* cnn = coarse.row(JJ);
+        T* f = fine.row(y);
+        for (int x = 0; x < fine.size_x(); ++x) {
+            int I = x/2;
+            int X = std::max(0, std::min((x % 2 == 0) ? I-1 : I+1, nx-1));
+            f[x] = (9.0*cn[I] + 3.0*cn[X] + 3.0*cnn[I] + cnn[X])/16.0;
+        }
+    }
+    fine.reflect_halo(0, fine.size_y());
+}
+
+template void convolve (Field<float> const&, std::vector<double> const&, Field<float>&);
+template void convolve (Field<double> const&, std::vector<double> const&, Field<double>&);
+template void compute_gradient (Field<float> const&, Field<float>&, Field<float>&, Field<float>&, double, int, int);
+template void compute_gradient (Field<double> const&, Field<double>&, Field<double>&, Field<double>&, double, int, int);
+template void compute_gradient_norm (Field<float> const&, Field<float>&, double, int, int, int);
+template void compute_gradient_norm (Field<double> const&, Field<double>&, double, int, int, int);
+template void recursive_gaussian (Field<float> const&, double, Field<float>&);
+template void recursive_gaussian (Field<double> const&, double, Field<double>&);
+template void gaussian_smooth (Field<float> const&, double, double, Field<float>&, std::string const&);
+template void gaussian_smooth (Field<double> const&, double, double, Field<double>&, std::string const&);
+template void start_step (Field<float> const&, Field<float>&, Field<float>&, double, double, int, int);
+template void start_step (Field<double> const&, Field<double>&, Field<double>&, double, double, int, int);
+template void coarsen (Field<float> const&, Field<float>&);
+template void coarsen (Field<double> const&, Field<double>&);
+template void interpolate (Field<float> const&, Field<float>&);
+template void interpolate (Field<double> const&, Field<double>&);
+
 std::vector<double> create_kernel (double sigma, double h) {
     int k_size = (int)ceil(6*sigma/h);
     if (k_size % 2 == 0) {
@@ -0,0 +1,329 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "batch.h"
+#include "data.h"
+#include "exceptions.h"
+#include "image_io.h"
+#include "phf-snakes.h"
+#include "utils.h"
+
+#include <boost/bind/bind.hpp>
+#include <boost/property_tree/info_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// A line of the manifest. load and solve record the errors of the job
+// instead of throwing them; solve does nothing after a failed load.
+class Batch_job {
+public:
+    Batch_job (int number, std::string const& line, boost::property_tree::ptree const& pt)
+        : number(number), line(line), pixels(0), threads(1), failed(false), seconds(0.0), background(false), pt_(pt)
+    { }
+    virtual ~Batch_job () { }
+
+    // Reads the parameters and the images and prepares the coarsest level
+    // of the pyramid.
+    void load () {
+        run(&Batch_job::do_load);
+    }
+
+    // Solves all levels and releases the fields.
+    void solve () {
+        if (!failed) {
+            run(&Batch_job::do_solve);
+        }
+    }
+
+    // Failures found before the job runs, e.g., a missing image.
+    void fail (std::string const& message) {
+        failed = true;
+        error = message;
+    }
+
+    int number;                 // line of the manifest
+    std::string line;
+    long pixels;                // of the image
+    int threads;
+    bool failed;
+    std::string error;
+    double seconds;             // spent loading and solving
+    std::string output_path;
+    std::string summary;
+    std::string memory;         // summary of the arena
+    bool background;            // loaded beside a solving team
+    // Of the fields; an arena given before load is reused, and after solve
+    // it is free for the next job.
+    boost::shared_ptr<Arena> arena;
+
+protected:
+    virtual void do_load () = 0;
+    virtual void do_solve () = 0;
+    // Frees the images and the fields of the job.
+    virtual void release () = 0;
+
+    boost::property_tree::ptree pt_;
+
+private:
+    void run (void (Batch_job::*work)()) {
+        double start = wall_time();
+        try {
+            (this->*work)();
+        }
+        catch (boost::exception & e) {
+            fail(boost::diagnostic_information(e));
+        }
+        catch (std::exception & e) {
+            fail(e.what());
+        }
+        if (failed) {
+            release();
+        }
+        seconds += wall_time() - start;
+    }
+};
+
+template <typename T>
+class Precision_job : public Batch_job {
+public:
+    Precision_job (int number, std::string const& line, boost::property_tree::ptree const& pt)
+        : Batch_job(number, line, pt)
+    { }
+
+private:
+    void do_load () {
+        data_.reset(new Phf_snakes_data<T>);
+        data_->threads = threads;
+        data_->verbose = false;
+        data_->defer_placement = background;
+        data_->output_tag = "_" + to_string(number, 3);
+        data_->arena = arena;
+        data_->read(pt_);
+        arena = data_->arena;
+        output_path = data_->output_path;
+        data_->initialize(data_->pyramid_levels - 1);
+    }
+
+    void do_solve () {
+        do {
+            solve_levels(*data_);
+        } while (data_->next_frame());
+        summary = data_->summary;
+        memory = data_->memory_summary();
+        data_.reset();
+    }
+
+    void release () {
+        data_.reset();
+    }
+
+    boost::scoped_ptr<Phf_snakes_data<T> > data_;
+};
+
+typedef boost::shared_ptr<Batch_job> job_ptr;
+
+// Returns the job of a line of the manifest that is not empty, or a failed
+// job if its parameters cannot be read.
+job_ptr parse_job (int number, std::string const& line, std::string const& default_parameters,
+                   std::map<std::string, boost::property_tree::ptree>& parameter_files) {
+    std::istringstream tokens(line);
+    std::string image, parameter_file = default_parameters, token;
+    tokens >> image;
+    std::vector<std::string> overrides;
+    while (tokens >> token) {
+        overrides.push_back(token);
+    }
+    if (!overrides.empty() && overrides[0].find('=') == std::string::npos) {
+        parameter_file = overrides[0];
+        overrides.erase(overrides.begin());
+    }
+
+    boost::property_tree::ptree pt;
+    std::string error;
+    try {
+        if (parameter_files.find(parameter_file) == parameter_files.end()) {
+            read_info(parameter_file, parameter_files[parameter_file]);
+        }
+        pt = parameter_files[parameter_file];
+        pt.put("image", image);
+        if (pt.get<bool>("volume.enabled", false))
+            BOOST_THROW_EXCEPTION(parameter_error() << string_info("volumes are segmented without --batch"));
+        for (std::size_t i = 0; i < overrides.size(); ++i) {
+            std::string::size_type eq = overrides[i].find('=');
+            if (eq == std::string::npos || eq == 0)
+                BOOST_THROW_EXCEPTION(parameter_error() << string_info("expected key=value, not " + overrides[i]));
+            pt.put(overrides[i].substr(0, eq), overrides[i].substr(eq + 1));
+        }
+        job_ptr job;
+        if (read_precision(pt) == "float") {
+            job.reset(new Precision_job<float>(number, line, pt));
+        } else {
+            job.reset(new Precision_job<double>(number, line, pt));
+        }
+        int size_x, size_y;
+        read_png_size(image + ".png", size_x, size_y);
+        job->pixels = long(size_x)*size_y;
+        return job;
+    }
+    catch (boost::exception & e) {
+        error = boost::diagnostic_information(e);
+    }
+    catch (std::exception & e) {
+        error = e.what();
+    }
+    job_ptr job(new Precision_job<double>(number, line, pt));
+    job->fail(error);
+    return job;
+}
+
+void report (Batch_job const& job) {
+    std::cout << "job " << job.number << " (" << job.line << "): ";
+    if (job.failed) {
+        std::cout << "failed\n" << job.error << std::endl;
+    } else {
+        std::cout << std::setprecision(3) << job.seconds << " s on " << job.threads
+                  << (job.threads == 1 ? " thread, " : " threads, ") << job.summary
+                  << (job.memory.empty() ? "" : ", " + job.memory)
+                  << ", results in " << job.output_path << std::endl;
+    }
+}
+
+// Loads a job in the background with a single thread so that the smoothing
+// of its image does not compete for the cores with the solver. The threads
+// are pinned and touch the fields first when the job is solved.
+void prefetch (job_ptr job) {
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+    job->background = true;
+    job->load();
+}
+
+}
+
+int run_batch (std::string const& manifest, std::string const& default_parameters) {
+    long large_image;
+    std::map<std::string, boost::property_tree::ptree> parameter_files;
+    try {
+        read_info(default_parameters, parameter_files[default_parameters]);
+        large_image = parameter_files[default_parameters].get<long>("batch.large_image", 262144);
+    }
+    catch (boost::exception & e) {
+        std::cerr << boost::diagnostic_information(e);
+        return EXIT_FAILURE;
+    }
+    std::ifstream file(manifest.c_str());
+    if (!file) {
+        std::cerr << "cannot open the batch manifest " << manifest << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<job_ptr> jobs, large, small;
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::string::size_type first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos) {
+            continue;
+        }
+        line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+        job_ptr job = parse_job(number, line, default_parameters, parameter_files);
+        jobs.push_back(job);
+        if (job->failed) {
+            report(*job);
+        } else if (job->pixels >= large_image) {
+            large.push_back(job);
+        } else {
+            small.push_back(job);
+        }
+    }
+#ifdef _OPENMP
+    int nthreads = omp_get_max_threads();
+#else
+    int nthreads = 1;
+#endif
+    std::cout << "batch " << manifest << ": " << jobs.size() << " jobs, " << large.size()
+              << " of them with at least " << large_image << " pixels solved by " << nthreads
+              << " threads each, the others by one thread each" << std::endl;
+    double start = wall_time();
+
+    // The arenas of the fields are handed from job to job: a large job
+    // takes the arena of the one before the last, as the next one is
+    // loaded while it is solved, and a small job that of its thread.
+    std::vector<boost::shared_ptr<Arena> > large_arenas(2), small_arenas(nthreads);
+    for (std::size_t i = 0; i < large.size(); ++i) {
+        large[i]->threads = nthreads;
+    }
+    if (!large.empty()) {
+        large[0]->load();
+    }
+    for (std::size_t i = 0; i < large.size(); ++i) {
+        boost::thread_group loader;
+        if (i + 1 < large.size()) {
+            large[i + 1]->arena = large_arenas[(i + 1) % 2];
+            loader.create_thread(boost::bind(prefetch, large[i + 1]));
+        }
+        large[i]->solve();
+        large_arenas[i % 2] = large[i]->arena;
+        large[i]->arena.reset();
+        report(*large[i]);
+        loader.join_all();
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < int(small.size()); ++i) {
+#ifdef _OPENMP
+        boost::shared_ptr<Arena>& arena = small_arenas[omp_get_thread_num()];
+#else
+        boost::shared_ptr<Arena>& arena = small_arenas[0];
+#endif
+        small[i]->arena = arena;
+        small[i]->load();
+        small[i]->solve();
+        arena = small[i]->arena;
+        small[i]->arena.reset();
+#pragma omp critical (batch_report)
+        report(*small[i]);
+    }
+
+    int failed = 0;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        failed += jobs[i]->failed;
+    }
+    std::cout << "batch " << manifest << ": " << jobs.size() - failed << " of " << jobs.size()
+              << " jobs done in " << std::setprecision(3) << wall_time() - start << " s" << std::endl;
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,48 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __BATCH_H_INCLUDED__
+#define __BATCH_H_INCLUDED__ 
+
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+// Segments the images listed in the manifest file in one process. Every line
+// of the manifest is a job
+//
+//     image [parameter file] [key=value ...]
+//
+// whose parameters are read from the parameter file, default_parameters if
+// it is not given, with the image and the keys of the line replaced, e.g.,
+// "images/a sigma=0.02 pyramid.levels=2". Text after '#' is a comment.
+//
+// Jobs whose image has at least batch.large_image pixels, as given in
+// default_parameters, are solved one after the other by all threads, while
+// the next one of them is loaded and smoothed in the background. The other
+// jobs are solved concurrently by one thread each, so that small images,
+// which do not scale over many threads, keep all cores busy. A failed job is
+// reported and does not stop the others; returns EXIT_FAILURE if any job
+// failed.
+///////////////////////////////////////////////////////////////////////////////
+
+int run_batch (std::string const& manifest, std::string const& default_parameters);
+
+#endif /* __BATCH_H_INCLUDED__ */
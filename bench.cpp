@@ -0,0 +1,379 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+///////////////////////////////////////////////////////////////////////////////
+// Measures the solver on synthetic images of several sizes and on the
+// bundled images and prints the results as JSON. For every run it reports
+// the time to smooth the image and to compute g, the number of Gauss-Seidel
+// sweeps per time step and the throughput of Phf_snakes::step in pixel
+// updates per second. The thread scaling is measured on one image of a fixed
+// size (strong) and on images whose size grows with the threads (weak).
+// Usage:
+//
+//   phf-snakes-bench [--sizes n,...] [--threads n,...] [--images name,...]
+//                    [--strong-size n] [--weak-size n] [--seconds s]
+//                    [key=value ...]
+//
+// The parameters are those of phf-snakes.dat with the keys given on the
+// command line replaced, e.g., gauss-seidel.simd=scalar or precision=float,
+// so that kernels and settings can be compared. Sizes whose fields would
+// not fit into half of the memory are skipped.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "array.h"
+#include "data.h"
+#include "exceptions.h"
+#include "image_io.h"
+#include "phf-snakes.h"
+#include "utils.h"
+
+#include <boost/property_tree/info_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Options {
+    Options ()
+        : strong_size(2048), weak_size(1024), seconds(1.0)
+    { }
+
+    std::vector<int> sizes;
+    std::vector<int> threads;
+    std::vector<std::string> images;
+    int strong_size;
+    int weak_size;          // per thread
+    double seconds;         // of time steps per run, at least
+};
+
+struct Result {
+    std::string benchmark;
+    std::string image;
+    int size_x, size_y;
+    int threads;
+    std::string skipped;    // the reason, or empty
+    double smooth_time;
+    double gh_time;
+    int steps;
+    long iterations;
+    double step_time;
+};
+
+std::vector<std::string> split_list (std::string const& list) {
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::vector<int> split_ints (std::string const& list) {
+    std::vector<std::string> items = split_list(list);
+    std::vector<int> values;
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        values.push_back(std::atoi(items[i].c_str()));
+        if (values.back() < 1)
+            BOOST_THROW_EXCEPTION(parameter_error() << string_info("not a positive number: " + items[i]));
+    }
+    return values;
+}
+
+std::string json_string (std::string const& s) {
+    std::string quoted = "\"";
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '"' || s[i] == '\\') {
+            quoted += '\\';
+        }
+        quoted += s[i];
+    }
+    return quoted + "\"";
+}
+
+// A dark disc and a dark square on a light background with a ripple, and an
+// outer contour a few pixels inside the border of the image.
+void synthetic_image (int size, field_t& P0, field_t& contour) {
+    P0.resize(size, size);
+    contour.resize(size, size);
+    int border = std::max(2, size/32);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            double u = double(x)/size, v = double(y)/size;
+            double dx = u - 0.35, dy = v - 0.4;
+            bool disc = dx*dx + dy*dy < 0.04;
+            bool square = u > 0.55 && u < 0.85 && v > 0.5 && v < 0.8;
+            P0(x, y) = (disc || square ? 0.2 : 0.8) + 0.05*std::sin(40.0*u)*std::cos(40.0*v);
+            bool inside = x >= border && x < size - border && y >= border && y < size - border;
+            contour(x, y) = inside ? 0.0 : 1.0;
+        }
+    }
+}
+
+// Estimated bytes per pixel of the images in double and of the fields of
+// the solver in T while an image is initialized and solved.
+template <typename T>
+double bytes_per_pixel () {
+    return 10*sizeof(double) + 8*sizeof(T);
+}
+
+double physical_memory () {
+    return double(sysconf(_SC_PHYS_PAGES))*sysconf(_SC_PAGE_SIZE);
+}
+
+// Solves time steps of P0 from the contour with the given number of
+// threads for at least the given time, after one step to warm up.
+template <typename T>
+Result measure (boost::property_tree::ptree const& pt, field_t const& P0, field_t const& contour,
+                int threads, double seconds)
+{
+    Result r;
+    r.size_x = P0.size_x();
+    r.size_y = P0.size_y();
+    r.threads = threads;
+    r.steps = 0;
+    r.iterations = 0;
+    if (bytes_per_pixel<T>()*r.size_x*r.size_y > 0.5*physical_memory()) {
+        r.skipped = "needs about " + to_string(int(bytes_per_pixel<T>()*r.size_x*r.size_y/(1 << 20))) + " MB";
+        return r;
+    }
+
+#ifdef _OPENMP
+    int default_threads = omp_get_max_threads();
+    omp_set_num_threads(threads);
+#endif
+    Phf_snakes_data<T> data;
+    data.threads = threads;
+    data.verbose = false;
+    data.configure(pt);
+    Field<T> initial(r.size_x, r.size_y);
+    for (int y = 0; y < r.size_y; ++y) {
+        std::copy(contour.row(y), contour.row(y) + r.size_x, initial.row(y));
+    }
+    data.set_images(P0, initial);
+    data.initialize(0);
+    r.smooth_time = data.smooth_time;
+    r.gh_time = data.gh_time;
+
+    bool done = false;
+    double start = 0.0;
+#pragma omp parallel default(shared) num_threads(threads)
+    {
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+#else
+        int tid = 0;
+        int nthreads = 1;
+#endif
+        Phf_snakes<T> problem(data, tid, nthreads);
+        problem.step(false);
+#pragma omp barrier
+#pragma omp master
+        start = wall_time();
+        do {
+            problem.step(false);
+#pragma omp master
+            {
+                ++r.steps;
+                r.iterations += problem.iterations();
+                r.step_time = wall_time() - start;
+                done = r.steps >= 3 && r.step_time >= seconds;
+            }
+#pragma omp barrier
+        } while (!done);
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(default_threads);
+#endif
+    return r;
+}
+
+void print (Result const& r, bool last) {
+    std::cout << "    {\"benchmark\": " << json_string(r.benchmark)
+              << ", \"image\": " << json_string(r.image)
+              << ", \"size_x\": " << r.size_x << ", \"size_y\": " << r.size_y
+              << ", \"threads\": " << r.threads;
+    if (!r.skipped.empty()) {
+        std::cout << ", \"skipped\": " << json_string(r.skipped);
+    } else {
+        double pixels = double(r.size_x)*r.size_y;
+        std::cout << std::setprecision(6)
+                  << ", \"smooth_s\": " << r.smooth_time
+                  << ", \"compute_gh_s\": " << r.gh_time
+                  << ", \"steps\": " << r.steps
+                  << ", \"sweeps_per_step\": " << double(r.iterations)/r.steps
+                  << ", \"step_s\": " << r.step_time/r.steps
+                  << ", \"pixel_updates_per_s\": " << pixels*r.iterations/r.step_time;
+    }
+    std::cout << "}" << (last ? "" : ",") << "\n";
+}
+
+template <typename T>
+int run (boost::property_tree::ptree const& pt, Options const& options)
+{
+    int max_threads = options.threads.back();
+    std::vector<Result> results;
+    field_t P0, contour;
+
+    for (std::size_t i = 0; i < options.sizes.size(); ++i) {
+        int size = options.sizes[i];
+        std::cerr << "size " << size << std::endl;
+        synthetic_image(size, P0, contour);
+        results.push_back(measure<T>(pt, P0, contour, max_threads, options.seconds));
+        results.back().benchmark = "size";
+        results.back().image = "synthetic";
+    }
+
+    std::string contour_suffix = pt.get<double>("F") >= 0.0 ? "-outer-contour.png" : "-inner-contour.png";
+    for (std::size_t i = 0; i < options.images.size(); ++i) {
+        std::string name = options.images[i];
+        std::cerr << "image " << name << std::endl;
+        Result r;
+        if (std::ifstream((name + ".png").c_str()) && std::ifstream((name + contour_suffix).c_str())) {
+            read_png(name + ".png", P0);
+            read_png(name + contour_suffix, contour);
+            r = measure<T>(pt, P0, contour, max_threads, options.seconds);
+        } else {
+            r.size_x = r.size_y = 0;
+            r.threads = max_threads;
+            r.skipped = "not found";
+        }
+        r.benchmark = "image";
+        r.image = name;
+        results.push_back(r);
+    }
+
+    synthetic_image(options.strong_size, P0, contour);
+    for (std::size_t i = 0; i < options.threads.size(); ++i) {
+        std::cerr << "strong scaling, " << options.threads[i] << " threads" << std::endl;
+        results.push_back(measure<T>(pt, P0, contour, options.threads[i], options.seconds));
+        results.back().benchmark = "strong";
+        results.back().image = "synthetic";
+    }
+
+    // The pixels per thread stay the same; the side is rounded to a
+    // multiple of 8.
+    for (std::size_t i = 0; i < options.threads.size(); ++i) {
+        int size = int(options.weak_size*std::sqrt(double(options.threads[i]))/8 + 0.5)*8;
+        std::cerr << "weak scaling, " << options.threads[i] << " threads" << std::endl;
+        synthetic_image(size, P0, contour);
+        results.push_back(measure<T>(pt, P0, contour, options.threads[i], options.seconds));
+        results.back().benchmark = "weak";
+        results.back().image = "synthetic";
+    }
+
+    Phf_snakes_data<T> data;
+    data.configure(pt);
+    std::cout << "{\n"
+              << "  \"precision\": " << json_string(sizeof(T) == sizeof(float) ? "float" : "double") << ",\n"
+              << "  \"solver\": " << json_string(data.solver_settings.method) << ",\n"
+              << "  \"kernel\": " << json_string(data.solver->kernel_name()) << ",\n"
+              << "  \"tolerance\": " << data.gs_conv_tolerance << ",\n"
+              << "  \"narrow_band\": " << (data.narrow_band ? "true" : "false") << ",\n"
+              << "  \"processors\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+              << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        print(results[i], i + 1 == results.size());
+    }
+    std::cout << "  ]\n}" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+}
+
+int main (int ac, char* av[]) {
+    Options options;
+    try {
+        boost::property_tree::ptree pt;
+        read_info("phf-snakes.dat", pt);
+        for (int i = 1; i < ac; ++i) {
+            std::string arg = av[i];
+            std::string::size_type eq = arg.find('=');
+            if (arg.compare(0, 2, "--") == 0 && i + 1 < ac) {
+                std::string value = av[++i];
+                if (arg == "--sizes") {
+                    options.sizes = split_ints(value);
+                } else if (arg == "--threads") {
+                    options.threads = split_ints(value);
+                } else if (arg == "--images") {
+                    options.images = split_list(value);
+                } else if (arg == "--strong-size") {
+                    options.strong_size = split_ints(value).at(0);
+                } else if (arg == "--weak-size") {
+                    options.weak_size = split_ints(value).at(0);
+                } else if (arg == "--seconds") {
+                    options.seconds = std::atof(value.c_str());
+                } else {
+                    BOOST_THROW_EXCEPTION(parameter_error() << string_info("unknown option " + arg));
+                }
+            } else if (eq != std::string::npos && eq > 0) {
+                pt.put(arg.substr(0, eq), arg.substr(eq + 1));
+            } else {
+                std::cerr << "usage: phf-snakes-bench [--sizes n,...] [--threads n,...] [--images name,...]\n"
+                          << "                        [--strong-size n] [--weak-size n] [--seconds s] [key=value ...]\n";
+                return EXIT_FAILURE;
+            }
+        }
+        pt.put("pyramid.levels", 1);
+
+        if (options.sizes.empty()) {
+            options.sizes = split_ints("256,1024,4096,16384");
+        }
+        if (options.threads.empty()) {
+            int max_threads = 1;
+#ifdef _OPENMP
+            max_threads = omp_get_max_threads();
+#endif
+            for (int t = 1; t < max_threads; t *= 2) {
+                options.threads.push_back(t);
+            }
+            options.threads.push_back(max_threads);
+        }
+        std::sort(options.threads.begin(), options.threads.end());
+        if (options.images.empty()) {
+            options.images = split_list("images/a,images/a-noise,images/q,images/shapes,images/shapes-noise");
+        }
+
+        if (read_precision(pt) == "float") {
+            return run<float>(pt, options);
+        }
+        return run<double>(pt, options);
+    }
+    catch (boost::exception & e) {
+        std::cerr << boost::diagnostic_information(e);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,181 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+///////////////////////////////////////////////////////////////////////////////
+// Measures how far the contour p = 1/2 of one result lies from that of
+// another, e.g., of a run in float from the same run in double. The contour
+// is represented by the points where p crosses 1/2 between horizontally or
+// vertically adjacent pixels, located by linear interpolation. For each point
+// of one contour the distance to the nearest point of the other one is
+// computed; the largest of these over both contours is the Hausdorff distance.
+// The snapshots in PNG are quantized to 1/255, which limits the accuracy of
+// the interpolated points to a few thousandths of a pixel; a file of frames
+// (.phf) gives p at full precision. Usage:
+//
+//   phf-snakes-contour-diff reference result
+//
+// where reference and result are snapshots in PNG or files of frames, of
+// which the last frame is compared, or the frame k with file.phf:k.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "exceptions.h"
+#include "frames.h"
+#include "image_io.h"
+#include "utils.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Point {
+    double x, y;
+};
+
+std::vector<Point> contour (field_t const& p) {
+    std::vector<Point> points;
+    for (int y = 0; y < p.size_y(); ++y) {
+        for (int x = 0; x < p.size_x(); ++x) {
+            double v = p(x, y) - 0.5;
+            if (x + 1 < p.size_x()) {
+                double r = p(x + 1, y) - 0.5;
+                if ((v < 0.0) != (r < 0.0)) {
+                    Point q = {x + v/(v - r), double(y)};
+                    points.push_back(q);
+                }
+            }
+            if (y + 1 < p.size_y()) {
+                double u = p(x, y + 1) - 0.5;
+                if ((v < 0.0) != (u < 0.0)) {
+                    Point q = {double(x), y + v/(v - u)};
+                    points.push_back(q);
+                }
+            }
+        }
+    }
+    return points;
+}
+
+// Reads p from a PNG snapshot or from a frame of a file of frames, name.phf
+// or name.phf:k.
+void read_result (std::string const& name, field_t& p) {
+    std::string::size_type phf = name.rfind(".phf");
+    if (phf == std::string::npos) {
+        read_png(name, p);
+        return;
+    }
+    Frame_reader reader(name.substr(0, phf + 4));
+    int k = reader.frames() - 1;
+    if (phf + 4 < name.size()) {
+        if (name[phf + 4] != ':')
+            BOOST_THROW_EXCEPTION(parameter_error() << string_info("expected file.phf or file.phf:frame, not " + name));
+        k = std::atoi(name.c_str() + phf + 5);
+    }
+    if (k < 0 || k >= reader.frames())
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("no frame " + to_string(k) + " in " + name));
+    if (reader.header().scalar_size == sizeof(float)) {
+        Field<float> q;
+        reader.read(k, q);
+        p.resize(q.size_x(), q.size_y());
+        for (int y = 0; y < q.size_y(); ++y) {
+            std::copy(q.row(y), q.row(y) + q.size_x(), p.row(y));
+        }
+    } else {
+        reader.read(k, p);
+    }
+}
+
+// Distances in pixels from the points of a to the nearest point of b.
+std::vector<double> distances (std::vector<Point> const& a, std::vector<Point> const& b) {
+    std::vector<double> d(a.size(), std::numeric_limits<double>::infinity());
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        double best = d[i]*d[i];
+        for (std::size_t j = 0; j < b.size(); ++j) {
+            double dx = a[i].x - b[j].x;
+            double dy = a[i].y - b[j].y;
+            double dd = dx*dx + dy*dy;
+            if (dd < best) {
+                best = dd;
+            }
+        }
+        d[i] = std::sqrt(best);
+    }
+    return d;
+}
+
+}
+
+int main (int ac, char* av[]) {
+    if (ac != 3) {
+        std::cerr << "usage: " << av[0] << " reference result, each a .png or a .phf[:frame]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    field_t reference, result;
+    try {
+        read_result(av[1], reference);
+        read_result(av[2], result);
+        if (reference.size_x() != result.size_x() || reference.size_y() != result.size_y())
+            BOOST_THROW_EXCEPTION(size_mismatch_error());
+    }
+    catch (boost::exception & e) {
+        std::cerr << boost::diagnostic_information(e);
+        return EXIT_FAILURE;
+    }
+
+    int flipped = 0;
+    for (int y = 0; y < reference.size_y(); ++y) {
+        for (int x = 0; x < reference.size_x(); ++x) {
+            if ((reference(x, y) < 0.5) != (result(x, y) < 0.5)) {
+                ++flipped;
+            }
+        }
+    }
+
+    std::vector<Point> a = contour(reference);
+    std::vector<Point> b = contour(result);
+    std::vector<double> d = distances(a, b);
+    std::vector<double> e = distances(b, a);
+    d.insert(d.end(), e.begin(), e.end());
+    double max = 0.0, sum = 0.0;
+    for (std::size_t i = 0; i < d.size(); ++i) {
+        max = std::max(max, d[i]);
+        sum += d[i];
+    }
+
+    std::cout << "contour points     = " << a.size() << ", " << b.size() << "\n"
+              << "pixels flipped     = " << flipped << " of " << reference.size_x()*reference.size_y() << "\n";
+    // Without a contour in one of the fields there is nothing to measure
+    // the other one against.
+    if (a.empty() != b.empty()) {
+        std::cout << "distance           = undefined, no contour in the "
+                  << (a.empty() ? "reference" : "result") << std::endl;
+        return EXIT_SUCCESS;
+    }
+    std::cout << "mean distance [px] = " << std::setprecision(4) << (d.empty() ? 0.0 : sum/d.size()) << "\n"
+              << "max distance [px]  = " << std::setprecision(4) << max << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -19,35 +19,65 @@
 //  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 //  IN THE SOFTWARE.
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "data.h"
 #include "exceptions.h"
 #include "image_io.h"
+#include "numa.h"
+#include "trace.h"
 #include "utils.h"
 
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/info_parser.hpp>
 
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <sched.h>
+#include <sstream>
+#include <unistd.h>
 
-void Phf_snakes_data::read_from_file(std::string const& filename) {
+std::string read_precision (std::string const& filename) {
     boost::property_tree::ptree pt;
     read_info(filename, pt);
+    return read_precision(pt);
+}
 
-    P0_filename        = pt.get<std::string>("image");
-    F                  = pt.get<double>("F");
-    lambda             = pt.get<double>("lambda");
-    sigma              = pt.get<double>("sigma");
-    C_s                = pt.get<double>("C_s");
-    h                  = pt.get<double>("h");
-    a                  = pt.get<double>("a");
-    save_images        = pt.get<bool>("save_images");
-    save_gnuplot       = pt.get<bool>("save_gnuplot");
-    save_every_n_step  = pt.get<int>("save_every_n_step");
-    check_every_n_step = pt.get<int>("check_every_n_step");
-    gs_conv_tolerance  = pt.get<double>("gauss-seidel.tolerance");
-    max_gs_iterations  = pt.get<int>("gauss-seidel.max_iterations");
-    add_noise          = pt.get<bool>("add_noise");
-    
+std::string read_precision (boost::property_tree::ptree const& pt) {
+    std::string precision = pt.get<std::string>("precision", "double");
+    if (precision != "double" && precision != "float")
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("unknown precision " + precision));
+    return precision;
+}
+
+template <typename T>
+void Phf_snakes_data<T>::read_from_file(std::string const& filename) {
+    boost::property_tree::ptree pt;
+    read_info(filename, pt);
+    read(pt);
+}
+
+// Reads the image and the contour named by the key image and prepares the
+// output directory, where it writes the parameters and the image.
+template <typename T>
+void Phf_snakes_data<T>::read(boost::property_tree::ptree const& pt) {
+    configure(pt);
+    P0_filename = pt.get<std::string>("image");
+    frame = -1;
+    if (sequence) {
+        if (P0_filename.find('%') == std::string::npos)
+            BOOST_THROW_EXCEPTION(parameter_error() << string_info("the image of a sequence has to be a pattern such as images/walk-%03d, not " + P0_filename));
+        image_pattern_ = P0_filename;
+        frame = first_frame;
+        P0_filename = frame_name(frame);
+    }
     std::string::size_type name_start = P0_filename.find_last_of('/');
     if (name_start == std::string::npos) {
         name_start = 0;
@@ -66,75 +96,476 @@ void Phf_snakes_data::read_from_file(std::string const& filename) {
         ini_filename = P0_filename + "-inner-contour.png";
     }
     P0_filename = P0_filename + ".png";
-    output_path = prepare_output_directory(problem_name_);
+    output_path = prepare_output_directory(problem_name_, output_tag);
     write_info(output_path + "phf-snakes.dat", pt);
+    std::ostringstream text;
+    write_info(text, pt);
+    parameters = text.str();
+    if (adaptive_tau) {
+        tau_log.open((output_path + "tau.dat").c_str());
+        tau_log << "# step time tau iterations max_change" << std::endl;
+    }
+    writer.start(save_buffers, save_async, save_threads, png_options);
+
+    TRACE_SCOPE("read images");
+    Arena::Scope scope(arena.get());
+    if (arena) {
+        arena->reset_peak();
+    }
+    read_png(P0_filename, P0_);
+    read_png(ini_filename, contour_);
+    start();
+    write_png(output_path + "P0.png", P0_);
+    write_gnuplot(output_path + "P0.dat", P0_);
+}
 
-    array_t P0;
-    read_png(P0_filename, P0);
-
-    size_x = P0.shape()[0];
-    size_y = P0.shape()[1];
-    p_old.resize (boost::extents[size_x  ][size_y  ]);
-    gx.resize    (boost::extents[size_x-1][size_y  ]);
-    gy.resize    (boost::extents[size_x  ][size_y-1]);
-    gh.resize    (boost::extents[size_x  ][size_y  ]);
-    gradpx.resize(boost::extents[size_x-1][size_y  ]);
-    gradpy.resize(boost::extents[size_x  ][size_y-1]);
-    gradp.resize (boost::extents[size_x  ][size_y  ]);
-
-    std::vector<double> kernel = create_kernel(sigma, h);
-    array_t P0_smooth(P0);
-    convolve(P0, kernel, P0_smooth);
-    compute_gh(P0_smooth);
-
-    read_png(ini_filename, p);
-    if (size_x != p.shape()[0] || size_y != p.shape()[1])
+// A sequence continues with the next frame while its image exists or, if
+// last is given, up to the last frame, which then has to exist.
+template <typename T>
+bool Phf_snakes_data<T>::next_frame() {
+    if (frame < 0) {
+        return false;
+    }
+    TRACE_SCOPE("next frame");
+    Arena::Scope scope(arena.get());
+    write_png(output_path + "frame-" + to_string(frame, 6) + ".png", p, png_options);
+    if (verbose) {
+        std::cout << "frame " << frame << ": " << summary << std::endl;
+    }
+    if (last_frame >= 0 ? frame == last_frame : !std::ifstream((frame_name(frame + 1) + ".png").c_str())) {
+        return false;
+    }
+    ++frame;
+    P0_filename = frame_name(frame) + ".png";
+    read_png(P0_filename, P0_);
+    contour_ = p;
+    start();
+    return true;
+}
+
+template <typename T>
+std::string Phf_snakes_data<T>::frame_name(int k) const {
+    return boost::str(boost::format(image_pattern_) % k);
+}
+
+template <typename T>
+void Phf_snakes_data<T>::set_images(field_t const& P0, Field<T> const& contour) {
+    Arena::Scope scope(arena.get());
+    if (arena) {
+        arena->reset_peak();
+    }
+    P0_ = P0;
+    contour_ = contour;
+    start();
+}
+
+// Checks the images and resets the state of a run so that the next call of
+// initialize starts on the coarsest level.
+template <typename T>
+void Phf_snakes_data<T>::start() {
+    if (P0_.size_x() != contour_.size_x() || P0_.size_y() != contour_.size_y())
         throw size_mismatch_error();
+    int coarsest = std::min(P0_.size_x(), P0_.size_y()) >> (pyramid_levels - 1);
+    if (coarsest < 8)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("the coarsest of " + to_string(pyramid_levels)
+                                                               + " pyramid levels would have fewer than 8 pixels"));
+    level = -1;
+    time = 0.0;
+    rejected_steps = 0;
+}
 
-    write_png(output_path + "p-" + to_string(0, 6) + ".png", p);
-    write_gnuplot(output_path + "p-" + to_string(0, 6) + ".dat", p);
-    write_png(output_path + "P0.png", P0);
-    write_gnuplot(output_path + "P0.dat", P0);
-    write_png(output_path + "P0_smooth.png", P0_smooth);
-    write_gnuplot(output_path + "P0_smooth.dat", P0_smooth);
+template <typename T>
+void Phf_snakes_data<T>::configure(boost::property_tree::ptree const& pt) {
+    // Fields hold the arena they come from, so it cannot be replaced while
+    // any of them is allocated.
+    if (arena && arena->in_use() > 0 && (!pt.get<bool>("memory.arena", true)
+                                         || arena->huge_pages() != pt.get<std::string>("memory.huge_pages", "none")))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("memory.arena and memory.huge_pages cannot change while fields are allocated"));
+    F                  = pt.get<double>("F");
+    lambda             = pt.get<double>("lambda");
+    sigma              = pt.get<double>("sigma");
+    smoothing          = pt.get<std::string>("smoothing", "auto");
+    C_s                = pt.get<double>("C_s");
+    h                  = pt.get<double>("h");
+    a                  = pt.get<double>("a");
+    save_images        = pt.get<bool>("save_images");
+    save_gnuplot       = pt.get<bool>("save_gnuplot");
+    save_every_n_step  = pt.get<int>("save_every_n_step");
+    save_async         = pt.get<bool>("save_async", true);
+    save_buffers       = pt.get<int>("save_buffers", 2);
+    save_threads       = pt.get<int>("save_threads", 1);
+    png_options.compression = pt.get<int>("png.compression", 1);
+    png_options.filter = pt.get<std::string>("png.filter", "up");
+    save_frames        = pt.get<bool>("save_frames", false);
+    frame_deltas       = pt.get<bool>("frame_deltas", true);
+    check_every_n_step = pt.get<int>("check_every_n_step");
+    gs_conv_tolerance  = pt.get<double>("gauss-seidel.tolerance");
+    max_gs_iterations  = pt.get<int>("gauss-seidel.max_iterations");
+    add_noise          = pt.get<bool>("add_noise");
+    narrow_band        = pt.get<bool>("narrow_band.enabled", false);
+    band_tile_size     = pt.get<int>("narrow_band.tile_size", 16);
+    band_threshold     = pt.get<double>("narrow_band.threshold", 1.0e-4);
+    adaptive_tau       = pt.get<bool>("time_step.adaptive", false);
+    tau_max            = pt.get<double>("time_step.max_tau", 8.0);
+    tau_max_change     = pt.get<double>("time_step.max_change", 0.1);
+    tau_target_iterations = pt.get<int>("time_step.target_iterations", 10);
+    pyramid_levels     = pt.get<int>("pyramid.levels", 1);
+    placement          = pt.get<std::string>("numa.placement", "none");
+    placement_report   = pt.get<bool>("numa.report", false);
+    use_arena          = pt.get<bool>("memory.arena", true);
+    huge_pages         = pt.get<std::string>("memory.huge_pages", "none");
+    arena_chunk        = pt.get<int>("memory.chunk_size", 64);
+    sequence           = pt.get<bool>("sequence.enabled", false);
+    first_frame        = pt.get<int>("sequence.first", 0);
+    last_frame         = pt.get<int>("sequence.last", -1);
+
+    Solver_settings& s = solver_settings;
+    s.method                   = pt.get<std::string>("solver", "gauss-seidel");
+    s.tolerance                = gs_conv_tolerance;
+    s.max_iterations           = max_gs_iterations;
+    std::string omega          = pt.get<std::string>("sor.omega", "auto");
+    s.omega                    = (omega == "auto") ? 0.0 : boost::lexical_cast<double>(omega);
+    s.multigrid.cycle          = pt.get<std::string>("multigrid.cycle", "V");
+    s.multigrid.pre_smoothing  = pt.get<int>("multigrid.pre_smoothing", 2);
+    s.multigrid.post_smoothing = pt.get<int>("multigrid.post_smoothing", 2);
+    s.multigrid.coarsest_sweeps = pt.get<int>("multigrid.coarsest_sweeps", 20);
+    s.multigrid.coarsest_size  = pt.get<int>("multigrid.coarsest_size", 8);
+
+    s.simd                     = pt.get<std::string>("gauss-seidel.simd", "auto");
+    s.schedule                 = pt.get<std::string>("gauss-seidel.schedule", "static");
+    s.task_rows                = pt.get<int>("gauss-seidel.task_rows", 16);
+    if (s.omega < 0.0 || s.omega >= 2.0)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("SOR omega " + omega + " not in (0,2)"));
+    if (narrow_band && s.method != "gauss-seidel" && s.method != "sor" && s.method != "chebyshev-sor")
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("the narrow band needs a red-black solver, not " + s.method));
+    if (narrow_band && band_tile_size < 1)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("narrow band tile size " + to_string(band_tile_size)));
+    if (smoothing != "fir" && smoothing != "recursive" && smoothing != "auto")
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("smoothing " + smoothing + " is not fir, recursive or auto"));
+    if (save_buffers < 1)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("save buffers " + to_string(save_buffers)));
+    if (save_async && save_threads < 1)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("save threads " + to_string(save_threads)));
+    if (png_options.compression < -1 || png_options.compression > 9)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("PNG compression " + to_string(png_options.compression) + " not in -1 to 9"));
+    if (!is_png_filter(png_options.filter))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("PNG filter " + png_options.filter));
+    if (sequence && (first_frame < 0 || (last_frame >= 0 && last_frame < first_frame)))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("sequence of frames " + to_string(first_frame) + " to " + to_string(last_frame)));
+    if (!is_placement(placement))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("thread placement " + placement + " is not none, close or spread"));
+    if (!is_huge_pages(huge_pages))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("huge pages " + huge_pages + " is not none, transparent or explicit"));
+    if (use_arena && arena_chunk < 1)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("arena chunk size " + to_string(arena_chunk) + " MiB"));
+    if (pyramid_levels < 1)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("pyramid levels " + to_string(pyramid_levels)));
+    if (adaptive_tau && (tau_max < 1.0 || tau_max_change <= 0.0 || tau_target_iterations < 1))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("adaptive time step needs max_tau >= 1, max_change > 0 and target_iterations >= 1"));
+    solver.reset(Solver<T>::create(s));
+    image_h_ = h;
+    if (!use_arena) {
+        arena.reset();
+    } else if (!arena || arena->huge_pages() != huge_pages) {
+        arena.reset(new Arena(huge_pages, std::size_t(arena_chunk) << 20));
+    }
+    if (arena) {
+        // The fields are placed by their first touch only on fresh pages.
+        arena->set_discard(placement != "none");
+    }
 }
 
-void Phf_snakes_data::print () const {
+// The level l of the pyramid halves the image l times and doubles h as
+// many times, so the interface, whose width xi is h, widens with it. On the
+// coarsest level the solve starts from the contour file, on the others from
+// p of the level below interpolated to the finer grid.
+template <typename T>
+void Phf_snakes_data<T>::initialize(int level) {
+    Arena::Scope scope(arena.get());
+    field_t P0(P0_);
+    Field<T> coarse_p;
+    if (level == pyramid_levels - 1) {
+        coarse_p = contour_;
+    } else {
+        coarse_p.swap(p);
+    }
+    for (int l = 0; l < level; ++l) {
+        field_t coarse;
+        coarsen(P0, coarse);
+        P0.swap(coarse);
+        if (level == pyramid_levels - 1) {
+            Field<T> coarse_contour;
+            coarsen(coarse_p, coarse_contour);
+            coarse_p.swap(coarse_contour);
+        }
+    }
+    this->level = level;
+    h = image_h_*(1 << level);
+    p_prefix = output_path + "p-" + (frame >= 0 ? "frame-" + to_string(frame, 6) + "-" : "")
+             + (level > 0 ? "level-" + to_string(level) + "-" : "");
+
+    // The threads are pinned before the fields of the solver are first
+    // touched by the threads that will update their rows; the calling
+    // thread gets its CPUs back at the end. A deferred initialize leaves
+    // both to place_fields.
+    Affinity_guard affinity;
+    int touch_threads = defer_placement ? 1 : threads;
+    if (!defer_placement) {
+        pin_threads(placement, threads);
+    }
+    size_x = P0.size_x();
+    size_y = P0.size_y();
+    p_old.resize (size_x, size_y, touch_threads);
+    gx.resize    (size_x, size_y, touch_threads);
+    gy.resize    (size_x, size_y, touch_threads);
+    gh.resize    (size_x, size_y, touch_threads);
+    gradp.resize (size_x, size_y, touch_threads);
+
+    // The image is smoothed and differentiated in double for either
+    // precision of the solver.
+    double start = wall_time();
+    field_t P0_smooth(P0);
+    {
+        TRACE_SCOPE("smooth");
+        gaussian_smooth(P0, sigma, h, P0_smooth, smoothing);
+        P0_smooth.reflect_halo(0, size_y);
+    }
+    smooth_time = wall_time() - start;
+    start = wall_time();
+    {
+        TRACE_SCOPE("compute_gh");
+        compute_gh(P0_smooth);
+    }
+    gh_time = wall_time() - start;
+
+    p.resize(size_x, size_y, touch_threads);
+    if (level == pyramid_levels - 1) {
+        p = coarse_p;
+    } else {
+        interpolate(coarse_p, p);
+    }
+    p.reflect_halo(0, size_y);
+    p_old = p;
+    if (narrow_band) {
+        band.setup(p, band_tile_size, band_threshold);
+    }
+
+    xi = h;
+    tau = xi*xi/a;
+    tau_limit = tau_max*tau;
+    if (!defer_placement) {
+        solver->setup(grid(), threads);
+        if (placement_report && verbose) {
+            print_placement();
+        }
+    }
+
+    frames.reset();
+    if (output_path.empty()) {
+        return;
+    }
+    TRACE_SCOPE("write initial images");
+    write_png(p_prefix + to_string(0, 6) + ".png", p);
+    write_gnuplot(p_prefix + to_string(0, 6) + ".dat", p);
+    if (save_frames) {
+        frames.reset(new Frame_writer<T>(p_prefix + "frames.phf", size_x, size_y, h, tau, level, parameters, frame_deltas));
+        frames->append(p, 0, 0.0, tau);
+    }
+    if (level == 0 && (frame < 0 || frame == first_frame)) {
+        write_png(output_path + "P0_smooth.png", P0_smooth);
+        write_gnuplot(output_path + "P0_smooth.dat", P0_smooth);
+    }
+}
+
+template <typename T>
+void Phf_snakes_data<T>::print () const {
     using namespace std;
     cout << "------------------------------------------------------------" << endl;
     cout << "input file   = " << P0_filename << endl;
     cout << "contour file = " << ini_filename << endl;
+    if (pyramid_levels > 1) {
+        cout << "level        = " << level << " of " << pyramid_levels << ", " << size_x << "x" << size_y << " pixels" << endl;
+    }
     cout << "h            = " << h << endl;
     cout << "a            = " << a << endl;
     cout << "F            = " << F << endl;
     cout << "C_s          = " << C_s << endl;
     cout << "lambda       = " << lambda << endl;
-    cout << "sigma        = " << sigma << endl;
-    cout << "G-S convergence tolerance = " << gs_conv_tolerance << endl;
-    cout << "maximum G-S iterations    = " << max_gs_iterations << endl;
+    cout << "sigma        = " << sigma << " (" << smoothing << " smoothing)" << endl;
+    cout << "solver tolerance          = " << gs_conv_tolerance << endl;
+    cout << "maximum solver iterations = " << max_gs_iterations << endl;
+    cout << "precision                 = " << (sizeof(T) == sizeof(float) ? "float" : "double") << endl;
+    cout << "G-S kernel                = " << solver->kernel_name() << endl;
+    cout << "solver                    = " << solver->description() << endl;
+    if (solver_settings.schedule == "tasks") {
+        cout << "schedule                  = tasks of " << solver_settings.task_rows << " rows" << endl;
+    }
+    if (narrow_band) {
+        cout << "narrow band               = " << band_tile_size << "x" << band_tile_size << " tiles, threshold "
+             << band_threshold << ", " << band.active_tiles() << " of " << band.tiles() << " active" << endl;
+    }
+    if (adaptive_tau) {
+        cout << "adaptive time step        = tau in [1, " << tau_max << "]*xi^2/a, change <= " << tau_max_change
+             << ", target iterations " << tau_target_iterations << endl;
+    }
     cout << "noise added to P0         = " << add_noise << endl;
     cout << "------------------------------------------------------------" << endl;
 }
 
-void Phf_snakes_data::compute_gh(array_t const& P0_smooth) {
-    compute_gradient(P0_smooth, gradpx, gradpy, gradp, h, 0, size_y);
+// The fields are copied into fields of the same size that the pinned team
+// has zeroed, i.e., touched first.
+template <typename T>
+void Phf_snakes_data<T>::place_fields() {
+    if (!defer_placement) {
+        return;
+    }
+    defer_placement = false;
+    Arena::Scope scope(arena.get());
+    Affinity_guard affinity;
+    pin_threads(placement, threads);
+    Field<T>* fields[] = {&p, &p_old, &gx, &gy, &gh, &gradp};
+    for (int i = 0; i < 6; ++i) {
+        Field<T> placed;
+        placed.resize(size_x, size_y, threads);
+        placed = *fields[i];
+        fields[i]->swap(placed);
+    }
+    solver->setup(grid(), threads);
+    if (placement_report && verbose) {
+        print_placement();
+    }
+}
+
+// Returns the peak and the mapped memory of the arena on one line.
+template <typename T>
+std::string Phf_snakes_data<T>::memory_summary () const {
+    if (!arena) {
+        return "";
+    }
+    double const MiB = 1024.0*1024.0;
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1) << "peak memory " << arena->peak()/MiB << " MiB of fields in "
+         << arena->mapped()/MiB << " MiB mapped, huge pages " << huge_pages;
+    if (arena->huge_pages_fallback()) {
+        text << " (none reserved, transparent ones used)";
+    }
+    return text.str();
+}
+
+// Returns the implicit system of a time step on the grid of the image.
+template <typename T>
+Sweep_grid<T> Phf_snakes_data<T>::grid () {
+    Sweep_grid<T> grid;
+    grid.size_x = size_x;
+    grid.size_y = size_y;
+    grid.p      = &p;
+    grid.p_old  = &p_old;
+    grid.gradp  = &gradp;
+    grid.gh     = &gh;
+    grid.gx     = &gx;
+    grid.gy     = &gy;
+    grid.band   = narrow_band ? &band : 0;
+    grid.parameters.tau = tau;
+    grid.parameters.xi = xi;
+    grid.parameters.a = a;
+    grid.parameters.F = F;
+    grid.parameters.h_pow2_inv = 1.0/(h*h);
+    grid.parameters.omega = 1.0;
+    return grid;
+}
+
+template <typename T>
+void Phf_snakes_data<T>::compute_gh(field_t const& P0_smooth) {
+    field_t dx(size_x, size_y), dy(size_x, size_y), norm(size_x, size_y);
+    // compute_gradient synchronizes the threads that call it, so it gets a
+    // team of its own; otherwise its barrier would bind to the team of a
+    // batch that initializes several jobs at once.
+#pragma omp parallel default(shared)
+    {
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+#else
+        int tid = 0;
+        int nthreads = 1;
+#endif
+        int y_start, y_end;
+        split_rows(size_y, tid, nthreads, y_start, y_end);
+        compute_gradient(P0_smooth, dx, dy, norm, h, y_start, y_end);
+    }
 
     for (int y = 0; y < size_y; y++) {
+        double const* gp = norm.row(y);
+        T* r = gx.row(y);
         for (int x = 0; x < size_x-1; x++) {
-            gx[x][y] = (g(gradp[x][y]) + g(gradp[x+1][y]))/2.0;
+            r[x] = (g(gp[x]) + g(gp[x+1]))/2.0;
         }
+        r[-1] = r[0];
+        r[size_x-1] = r[size_x-2];
     }
 
     for (int y = 0; y < size_y-1; y++) {
+        double const* gp  = norm.row(y);
+        double const* gpu = norm.row(y+1);
+        T* r = gy.row(y);
         for (int x = 0; x < size_x; x++) {
-            gy[x][y] = (g(gradp[x][y]) + g(gradp[x][y+1]))/2.0;
+            r[x] = (g(gp[x]) + g(gpu[x]))/2.0;
         }
     }
+    std::copy(gy.row(0), gy.row(0) + size_x, gy.row(-1));
+    std::copy(gy.row(size_y-2), gy.row(size_y-2) + size_x, gy.row(size_y-1));
 
     for (int y = 0; y < size_y; y++) {
+        double const* gp = norm.row(y);
+        T* r = gh.row(y);
         for (int x = 0; x < size_x; x++) {
-            gh[x][y] = g(gradp[x][y]);
+            r[x] = g(gp[x]);
+        }
+    }
+}
+
+// Prints the CPU of every thread and the nodes of the pages of its rows of
+// the fields that the time step updates or reads.
+template <typename T>
+void Phf_snakes_data<T>::print_placement() {
+    std::vector<int> cpus(threads, -1);
+#pragma omp parallel default(shared) num_threads(threads)
+    {
+#ifdef _OPENMP
+        cpus[omp_get_thread_num()] = sched_getcpu();
+#else
+        cpus[0] = sched_getcpu();
+#endif
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    Field<T> const* fields[] = {&p, &p_old, &gradp, &gh, &gx, &gy};
+    std::cout << "pages of the rows of p, p_old, gradp, gh, gx and gy (placement " << placement << "):" << std::endl;
+    for (int tid = 0; tid < threads; ++tid) {
+        int y_start, y_end;
+        split_rows(size_y, tid, threads, y_start, y_end);
+        std::vector<void*> pages;
+        for (int i = 0; i < 6; ++i) {
+            std::size_t begin = reinterpret_cast<std::size_t>(fields[i]->row(y_start) - Field<T>::pad);
+            std::size_t end = reinterpret_cast<std::size_t>(fields[i]->row(y_end) - Field<T>::pad);
+            for (std::size_t a = begin/page*page; a < end; a += page) {
+                pages.push_back(reinterpret_cast<void*>(a));
+            }
+        }
+        std::vector<int> nodes = page_nodes(pages);
+        std::map<int, int> count;
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            ++count[nodes[i]];
+        }
+        std::cout << "thread " << std::setw(3) << tid << " on cpu " << std::setw(3) << cpus[tid]
+                  << " (node " << cpu_node(cpus[tid]) << "), rows " << y_start << " to " << y_end - 1
+                  << ", " << pages.size() << " pages:";
+        for (std::map<int, int>::const_iterator it = count.begin(); it != count.end(); ++it) {
+            std::cout << " " << (it->first < 0 ? std::string("unknown") : "node " + to_string(it->first))
+                      << " " << std::setprecision(3) << 100.0*it->second/pages.size() << "%";
         }
+        std::cout << std::endl;
     }
 }
 
+template class Phf_snakes_data<float>;
+template class Phf_snakes_data<double>;
@@ -1,47 +1,166 @@
 #ifndef __DATA_H_INCLUDED__
 #define __DATA_H_INCLUDED__ 
 
+#include "arena.h"
 #include "array.h"
+#include "frames.h"
+#include "snapshot-writer.h"
+#include "solver.h"
+#include "sweep.h"
 
+#include <boost/property_tree/ptree_fwd.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <fstream>
 #include <string>
+#include <vector>
+
+// Returns the precision of the fields given in the parameter file, "double"
+// or "float".
+std::string read_precision (std::string const& filename);
+std::string read_precision (boost::property_tree::ptree const& pt);
 
+// Parameters and fields shared by the threads. The fields of the solver are
+// stored in T, which is float or double.
+template <typename T>
 class Phf_snakes_data {
 public:
+    Phf_snakes_data ()
+        : sequence(false), frame(-1), threads(1), verbose(true), defer_placement(false), smooth_time(0.0), gh_time(0.0), level(-1)
+    { }
+
+    // Reads the parameters and the images; initialize then prepares the
+    // fields of a level of the pyramid. threads, verbose and output_tag have
+    // to be set before.
     void read_from_file(std::string const& filename);
+    void read(boost::property_tree::ptree const& pt);
+    void initialize(int level);
+    // After an initialize with defer_placement, pins the threads, lets
+    // them touch the fields of their rows first and sets up the solver;
+    // does nothing otherwise. solve_levels calls it before it solves.
+    void place_fields();
+
+    // Without the files: configure reads the parameters other than the
+    // image, set_images then starts a run on P0 from the contour. The fields
+    // of the solver are kept between runs on images of the same size.
+    // Nothing is written while output_path is empty.
+    void configure(boost::property_tree::ptree const& pt);
+    void set_images(field_t const& P0, Field<T> const& contour);
+
+    // In a sequence, writes p of the frame just solved to frame-<n>.png,
+    // reads the next frame and starts a run on it from that p; returns
+    // false, without starting a run, after the last frame or outside a
+    // sequence.
+    bool next_frame();
     void print () const;
+    Sweep_grid<T> grid ();
+    // The peak of the memory of the fields since the last read or
+    // set_images and the memory of the arena, or nothing without an arena.
+    std::string memory_summary () const;
 
     double h;
+    double xi;
     double tau;
     double a;
     double F;
     double lambda;
     double sigma;
+    std::string smoothing;      // fir, recursive or auto
     double gs_conv_tolerance;
     bool add_noise;
     bool save_images, save_gnuplot;
     int save_every_n_step;
+    bool save_async;
+    int save_buffers;
+    int save_threads;
+    Png_options png_options;    // of the snapshots
+    bool save_frames, frame_deltas;
     int check_every_n_step;
     double C_s;
     int max_gs_iterations;
+    bool narrow_band;
+    int band_tile_size;
+    double band_threshold;
+    bool adaptive_tau;
+    double tau_max;             // in units of xi^2/a, the fixed time step
+    double tau_max_change;
+    int tau_target_iterations;
+    int pyramid_levels;
+    std::string placement;      // of the threads: none, close or spread
+    bool placement_report;      // print the nodes of the pages of every thread
+    bool use_arena;             // allocate the fields from arena
+    std::string huge_pages;     // none, transparent or explicit
+    int arena_chunk;            // smallest mapping of the arena, in MiB
+    bool sequence;              // image is a pattern of the names of frames
+    int first_frame, last_frame;    // last -1 until a frame is missing
+    int frame;                  // being solved, or -1 outside a sequence
+    Solver_settings solver_settings;
     std::string ini_filename;
     std::string P0_filename;
     std::string output_path;
+    std::string p_prefix;       // output_path and the prefix of the files of p
+    std::string parameters;     // the text of the configuration
+    std::string output_tag;     // appended to the name of the output directory
+
+    int threads;                // of the team that solves
+    bool verbose;               // print the settings and the progress
+    bool defer_placement;       // initialize beside a solving team: one thread, no pinning
+    std::string summary;        // of the solver on the last level solved
+    double smooth_time;         // of the image by the last initialize, in s
+    double gh_time;             // of g by the last initialize, in s
+
+    // The memory of the fields, declared before them so that it outlives
+    // them. An arena set before configure is kept if it has the huge pages
+    // of the parameters, so that a job reuses the arena of the one before;
+    // configure refuses to replace an arena that fields are allocated from.
+    boost::shared_ptr<Arena> arena;
+
+    int level;                  // of the pyramid, 0 for the resolution of the image
 
     int size_x, size_y;
 
-    array_t p_old, p;
-    array_t gx, gy, gh, gradp, gradpx, gradpy;
+    // gx(x,y) and gy(x,y) hold the values of g between the pixels (x,y) and
+    // (x+1,y) or (x,y+1), respectively. Their halos and the last column of
+    // gx and the last row of gy repeat the values next to the boundary.
+    Field<T> p_old, p;
+    Field<T> gx, gy, gh, gradp;
+
+    Narrow_band band;
+    boost::shared_ptr<Solver<T> > solver;
+
+    // Writes the snapshots of p taken while solving; snapshot is the
+    // buffer being filled.
+    Snapshot_writer<T> writer;
+    typename Snapshot_writer<T>::Snapshot* snapshot;
+    boost::shared_ptr<Frame_writer<T> > frames;     // of the current level
+
+    std::vector<double> stat_diff, residual, max_change;
+    bool solve_end;
 
-    std::vector<double> conv_diff, stat_diff;
-    bool solve_end, step_end;
+    // State of the adaptive time step: whether the last step has to be
+    // repeated with a smaller tau, the largest tau still allowed, the time
+    // reached, the number of repeated steps and the log of the accepted
+    // steps.
+    bool step_rejected;
+    double tau_limit;
+    double time;
+    int rejected_steps;
+    std::ofstream tau_log;
 
 private:
-    void compute_gh(array_t const& P0_smooth);
+    void start();
+    std::string frame_name(int k) const;
+    void compute_gh(field_t const& P0_smooth);
+    void print_placement();
     double g (double s) const {
         return 1.0/(1.0 + lambda*s*s);
     }
 
     std::string problem_name_;
+    std::string image_pattern_;
+    double image_h_;
+    field_t P0_;
+    Field<T> contour_;
 };
 
 #endif /* __DATA_H_INCLUDED__ */
@@ -0,0 +1,466 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "data.h"
+#include "distributed.h"
+#include "exceptions.h"
+#include "image_io.h"
+#include "utils.h"
+
+#include <boost/property_tree/info_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+template <typename T> MPI_Datatype mpi_type ();
+template <> MPI_Datatype mpi_type<float> ()  { return MPI_FLOAT; }
+template <> MPI_Datatype mpi_type<double> () { return MPI_DOUBLE; }
+
+// Tags of the ghosts by the direction in which they travel.
+enum { to_down, to_up, to_left, to_right };
+
+// Copies the block of src at (x0, y0) with its halo into dst.
+template <typename T>
+void copy_block (Field<T> const& src, int x0, int y0, Field<T>& dst) {
+    for (int y = -1; y <= dst.size_y(); ++y) {
+        T const* s = src.row(y0 + y) + x0;
+        std::copy(s - 1, s + dst.size_x() + 1, dst.row(y) - 1);
+    }
+}
+
+}
+
+template <typename T>
+Phf_snakes_distributed<T>::Phf_snakes_distributed (MPI_Comm comm)
+    : threads(1), verbose(true), requests_(8), exchange_time_(0.0)
+{
+    MPI_Comm_size(comm, &ranks_);
+    dims_[0] = dims_[1] = 0;
+    MPI_Dims_create(ranks_, 2, dims_);
+    int periods[2] = {0, 0};
+    MPI_Cart_create(comm, 2, dims_, periods, 0, &comm_);
+    MPI_Comm_rank(comm_, &rank_);
+    MPI_Cart_shift(comm_, 0, 1, &down_, &up_);
+    MPI_Cart_shift(comm_, 1, 1, &left_, &right_);
+}
+
+template <typename T>
+Phf_snakes_distributed<T>::~Phf_snakes_distributed () {
+    MPI_Comm_free(&comm_);
+}
+
+// Every rank reads the image and computes g on all of it, as the shared
+// memory solver does, and then keeps only its block; the fields of the
+// solver are allocated for the block alone.
+template <typename T>
+void Phf_snakes_distributed<T>::read (boost::property_tree::ptree const& pt) {
+    std::string image = pt.get<std::string>("image");
+    Phf_snakes_data<T> data;
+    data.threads = threads;
+    data.verbose = false;
+    data.configure(pt);
+    if (data.solver_settings.method != "gauss-seidel")
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("the MPI solver is gauss-seidel, not " + data.solver_settings.method));
+    if (data.narrow_band || data.adaptive_tau || data.pyramid_levels != 1 || data.sequence || pt.get<bool>("volume.enabled", false))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("the MPI solver supports neither the narrow band, the adaptive time step, the pyramid, sequences nor volumes"));
+
+    C_s_ = data.C_s;
+    tolerance_ = data.gs_conv_tolerance;
+    max_iterations_ = data.max_gs_iterations;
+    check_every_n_step_ = data.check_every_n_step;
+    save_every_n_step_ = data.save_every_n_step;
+    save_images_ = data.save_images;
+    png_options_ = data.png_options;
+    image_name_ = image + ".png";
+
+    std::string contour_name = image + (data.F >= 0.0 ? "-outer-contour.png" : "-inner-contour.png");
+    read_png_size(image_name_, size_x_, size_y_);
+    int contour_x, contour_y;
+    read_png_size(contour_name, contour_x, contour_y);
+    if (contour_x != size_x_ || contour_y != size_y_)
+        throw size_mismatch_error();
+    if (size_y_/dims_[0] < 2 || size_x_/dims_[1] < 2)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("a block of the " + to_string(size_x_) + "x" + to_string(size_y_)
+                                                               + " image split among " + to_string(dims_[1]) + "x" + to_string(dims_[0])
+                                                               + " ranks would have fewer than 2 pixels"));
+    block_of(rank_, x0_, y0_, block_x_, block_y_);
+
+    // No rank holds the whole image: each one reads the window of its block
+    // and a halo and initializes the fields on the window alone. The ghosts
+    // of the block need the gradient of the smoothed image one pixel beyond
+    // them, and g between pixels one more, so with a halo of the radius of
+    // the kernel and three pixels the block and its ghosts are the same as
+    // on the whole image. The response of the recursive filter has no end;
+    // four times the radius, twelve sigma, leaves differences of about 1e-9.
+    int radius = int(create_kernel(data.sigma, data.h).size())/2;
+    if (data.smoothing != "fir" && (data.smoothing == "recursive" || 2*radius + 1 > recursive_kernel_size))
+        radius *= 4;
+    int halo = std::max(radius + 3, 6);
+    int wx0 = std::max(x0_ - halo, 0);
+    int wy0 = std::max(y0_ - halo, 0);
+    int wx1 = std::min(x0_ + block_x_ + halo, size_x_);
+    int wy1 = std::min(y0_ + block_y_ + halo, size_y_);
+    {
+        field_t P0;
+        Field<T> contour;
+        read_png(image_name_, P0, wx0, wy0, wx1 - wx0, wy1 - wy0);
+        read_png(contour_name, contour, wx0, wy0, wx1 - wx0, wy1 - wy0);
+        data.set_images(P0, contour);
+    }
+    data.initialize(0);
+
+    p_.resize(block_x_, block_y_);
+    gh_.resize(block_x_, block_y_);
+    gx_.resize(block_x_, block_y_);
+    gy_.resize(block_x_, block_y_);
+    gradp_.resize(block_x_, block_y_);
+    copy_block(data.p, x0_ - wx0, y0_ - wy0, p_);
+    copy_block(data.gh, x0_ - wx0, y0_ - wy0, gh_);
+    copy_block(data.gx, x0_ - wx0, y0_ - wy0, gx_);
+    copy_block(data.gy, x0_ - wx0, y0_ - wy0, gy_);
+    p_old_ = p_;
+    send_left_.resize(block_y_);
+    send_right_.resize(block_y_);
+    recv_left_.resize(block_y_);
+    recv_right_.resize(block_y_);
+
+    h_ = data.h;
+    grid_ = data.grid();
+    grid_.size_x = block_x_;
+    grid_.size_y = block_y_;
+    grid_.p      = &p_;
+    grid_.p_old  = &p_old_;
+    grid_.gradp  = &gradp_;
+    grid_.gh     = &gh_;
+    grid_.gx     = &gx_;
+    grid_.gy     = &gy_;
+
+    if (rank_ == 0) {
+        std::string::size_type name_start = image.find_last_of('/');
+        name_start = (name_start == std::string::npos) ? 0 : name_start + 1;
+        output_path_ = prepare_output_directory(image.substr(name_start));
+        write_info(output_path_ + "phf-snakes.dat", pt);
+    }
+}
+
+// Returns the block of the rank: the rows and the columns of the image are
+// split among the rows and the columns of the grid of ranks as split_rows
+// splits the rows among threads.
+template <typename T>
+void Phf_snakes_distributed<T>::block_of (int rank, int& x0, int& y0, int& block_x, int& block_y) const {
+    int coords[2];
+    MPI_Cart_coords(comm_, rank, 2, coords);
+    int y_end, x_end;
+    split_rows(size_y_, coords[0], dims_[0], y0, y_end);
+    split_rows(size_x_, coords[1], dims_[1], x0, x_end);
+    block_x = x_end - x0;
+    block_y = y_end - y0;
+}
+
+// The pixel (x, y) of the block has the colour of the parity of its
+// coordinates in the image. The first and the last row and column of the
+// block are its edges, which the neighbours need as their ghosts.
+template <typename T>
+double Phf_snakes_distributed<T>::relax_edges (int color) {
+    Sweep_parameters const& c = grid_.parameters;
+    int parity = x0_ + y0_ + color;
+    double diff = 0.0;
+    for (int y = 0; y < block_y_; y += block_y_ - 1) {
+        Row_stencil<T> s = grid_.stencil(y);
+        for (int x = (parity + y) % 2; x < block_x_; x += 2) {
+            diff = std::max(diff, relax_point<false>(s, c, x));
+        }
+    }
+    for (int y = 1; y < block_y_ - 1; ++y) {
+        Row_stencil<T> s = grid_.stencil(y);
+        if ((parity + y) % 2 == 0) {
+            diff = std::max(diff, relax_point<false>(s, c, 0));
+        }
+        if ((parity + y + block_x_ - 1) % 2 == 0) {
+            diff = std::max(diff, relax_point<false>(s, c, block_x_ - 1));
+        }
+    }
+    return diff;
+}
+
+template <typename T>
+double Phf_snakes_distributed<T>::relax_interior (int color, int y_start, int y_end) {
+    Sweep_parameters const& c = grid_.parameters;
+    int parity = x0_ + y0_ + color;
+    double diff = 0.0;
+    for (int y = y_start; y < y_end; ++y) {
+        Row_stencil<T> s = grid_.stencil(y);
+        for (int x = 1 + (parity + y + 1) % 2; x < block_x_ - 1; x += 2) {
+            diff = std::max(diff, relax_point<false>(s, c, x));
+        }
+    }
+    return diff;
+}
+
+// Sends the edges of p to the neighbours and receives their edges into the
+// ghosts. The rows go directly from and to p, the columns through buffers.
+template <typename T>
+void Phf_snakes_distributed<T>::start_exchange () {
+    MPI_Datatype type = mpi_type<T>();
+    for (int y = 0; y < block_y_; ++y) {
+        send_left_[y] = p_.row(y)[0];
+        send_right_[y] = p_.row(y)[block_x_ - 1];
+    }
+    MPI_Irecv(p_.row(-1), block_x_, type, down_, to_up, comm_, &requests_[0]);
+    MPI_Irecv(p_.row(block_y_), block_x_, type, up_, to_down, comm_, &requests_[1]);
+    MPI_Irecv(&recv_left_[0], block_y_, type, left_, to_right, comm_, &requests_[2]);
+    MPI_Irecv(&recv_right_[0], block_y_, type, right_, to_left, comm_, &requests_[3]);
+    MPI_Isend(p_.row(0), block_x_, type, down_, to_down, comm_, &requests_[4]);
+    MPI_Isend(p_.row(block_y_ - 1), block_x_, type, up_, to_up, comm_, &requests_[5]);
+    MPI_Isend(&send_left_[0], block_y_, type, left_, to_left, comm_, &requests_[6]);
+    MPI_Isend(&send_right_[0], block_y_, type, right_, to_right, comm_, &requests_[7]);
+}
+
+template <typename T>
+void Phf_snakes_distributed<T>::finish_exchange () {
+    double start = wall_time();
+    MPI_Waitall(requests_.size(), &requests_[0], MPI_STATUSES_IGNORE);
+    exchange_time_ += wall_time() - start;
+    if (left_ != MPI_PROC_NULL) {
+        for (int y = 0; y < block_y_; ++y) {
+            p_.row(y)[-1] = recv_left_[y];
+        }
+    }
+    if (right_ != MPI_PROC_NULL) {
+        for (int y = 0; y < block_y_; ++y) {
+            p_.row(y)[block_x_] = recv_right_[y];
+        }
+    }
+}
+
+// Mirrors the values next to the boundary of the image into the ghosts on
+// the sides of the block that have no neighbour.
+template <typename T>
+void Phf_snakes_distributed<T>::reflect_boundary (Field<T>& f) {
+    for (int y = 0; y < block_y_; ++y) {
+        T* r = f.row(y);
+        if (left_ == MPI_PROC_NULL) {
+            r[-1] = r[1];
+        }
+        if (right_ == MPI_PROC_NULL) {
+            r[block_x_] = r[block_x_ - 2];
+        }
+    }
+    if (down_ == MPI_PROC_NULL) {
+        std::copy(f.row(1) - 1, f.row(1) + block_x_ + 1, f.row(-1) - 1);
+    }
+    if (up_ == MPI_PROC_NULL) {
+        std::copy(f.row(block_y_ - 2) - 1, f.row(block_y_ - 2) + block_x_ + 1, f.row(block_y_) - 1);
+    }
+}
+
+// Gathers p on rank 0, which writes it as the snapshot with the given index.
+template <typename T>
+void Phf_snakes_distributed<T>::save (int index) {
+    std::vector<T> block(block_x_*block_y_);
+    for (int y = 0; y < block_y_; ++y) {
+        std::copy(p_.row(y), p_.row(y) + block_x_, &block[y*block_x_]);
+    }
+    std::vector<T> all;
+    std::vector<int> counts, displs;
+    if (rank_ == 0) {
+        all.resize(size_x_*size_y_);
+        counts.resize(ranks_);
+        displs.resize(ranks_);
+        for (int r = 0, offset = 0; r < ranks_; ++r) {
+            int x0, y0, bx, by;
+            block_of(r, x0, y0, bx, by);
+            counts[r] = bx*by;
+            displs[r] = offset;
+            offset += bx*by;
+        }
+    }
+    MPI_Gatherv(&block[0], block.size(), mpi_type<T>(), rank_ == 0 ? &all[0] : 0,
+                rank_ == 0 ? &counts[0] : 0, rank_ == 0 ? &displs[0] : 0, mpi_type<T>(), 0, comm_);
+    if (rank_ != 0) {
+        return;
+    }
+    Field<T> p(size_x_, size_y_);
+    for (int r = 0; r < ranks_; ++r) {
+        int x0, y0, bx, by;
+        block_of(r, x0, y0, bx, by);
+        for (int y = 0; y < by; ++y) {
+            T const* s = &all[displs[r] + y*bx];
+            std::copy(s, s + bx, p.row(y0 + y) + x0);
+        }
+    }
+    write_png(output_path_ + "p-" + to_string(index, 6) + ".png", p, png_options_);
+}
+
+template <typename T>
+void Phf_snakes_distributed<T>::solve () {
+    if (verbose && rank_ == 0) {
+        std::cout << "------------------------------------------------------------\n"
+                  << "input file   = " << image_name_ << ", " << size_x_ << "x" << size_y_ << " pixels\n"
+                  << "h            = " << h_ << "\n"
+                  << "a            = " << grid_.parameters.a << "\n"
+                  << "F            = " << grid_.parameters.F << "\n"
+                  << "C_s          = " << C_s_ << "\n"
+                  << "precision    = " << (sizeof(T) == sizeof(float) ? "float" : "double") << "\n"
+                  << "ranks        = " << ranks_ << " in " << dims_[1] << "x" << dims_[0] << " blocks of about "
+                  << size_x_/dims_[1] << "x" << size_y_/dims_[0] << " pixels\n"
+                  << "threads      = " << threads << " per rank\n"
+                  << "------------------------------------------------------------" << std::endl;
+    }
+    diff_.assign(threads, 0.0);
+    solve_end_ = false;
+    steps_ = 0;
+    iterations_ = 0;
+    save(0);
+    double start = wall_time();
+#pragma omp parallel default(shared) num_threads(threads)
+    {
+#ifdef _OPENMP
+        solve_thread(omp_get_thread_num(), omp_get_num_threads());
+#else
+        solve_thread(0, 1);
+#endif
+    }
+    double time = wall_time() - start;
+    if (verbose && rank_ == 0) {
+        std::cout << "\ngauss-seidel: " << steps_ << " time steps, " << iterations_ << " iterations ("
+                  << std::setprecision(3) << double(iterations_)/steps_ << " per step), "
+                  << time << " s, " << exchange_time_ << " s waiting for the ghosts on rank 0" << std::endl;
+    }
+    int index = steps_/save_every_n_step_;
+    if (!save_images_ || steps_ % save_every_n_step_ != 0) {
+        save(steps_ % save_every_n_step_ == 0 ? index : index + 1);
+    }
+}
+
+template <typename T>
+void Phf_snakes_distributed<T>::solve_thread (int tid, int nthreads) {
+    int y_start, y_end;
+    split_rows(block_y_, tid, nthreads, y_start, y_end);
+    int interior_start, interior_end;
+    split_rows(block_y_ - 2, tid, nthreads, interior_start, interior_end);
+    ++interior_start;
+    ++interior_end;
+    double tau = grid_.parameters.tau;
+    double M = 1.0/(h_*h_*(size_x_ - 1)*(size_y_ - 1));
+    int nstep = 0;
+    do {
+        // p becomes p_old and the solver starts from p extrapolated from
+        // the last two steps, as in the shared memory solver. The ghosts
+        // are extrapolated with the rest, which gives the same values as
+        // the neighbours compute for their edges.
+#pragma omp barrier
+#pragma omp master
+        p_.swap(p_old_);
+#pragma omp barrier
+        start_step(p_old_, p_, gradp_, 1.0, h_, y_start, y_end);
+#pragma omp barrier
+
+        // The edges of one colour are sent while the interior of the same
+        // colour is updated; both read only pixels of the other colour,
+        // whose ghosts arrived after the previous half-sweep. The largest
+        // change is reduced over the ranks with the ghosts of the second
+        // half-sweep.
+        int k = 0;
+        for (;;) {
+            double local_diff = 0.0;
+            for (int color = 0; color < 2; ++color) {
+#pragma omp master
+                {
+                    local_diff = std::max(local_diff, relax_edges(color));
+                    start_exchange();
+                }
+                local_diff = std::max(local_diff, relax_interior(color, interior_start, interior_end));
+                if (color == 1) {
+                    diff_[tid] = local_diff;
+                }
+#pragma omp barrier
+#pragma omp master
+                {
+                    finish_exchange();
+                    reflect_boundary(p_);
+                    if (color == 1) {
+                        double diff = *std::max_element(diff_.begin(), diff_.end());
+                        MPI_Allreduce(&diff, &global_diff_, 1, MPI_DOUBLE, MPI_MAX, comm_);
+                    }
+                }
+#pragma omp barrier
+            }
+            ++k;
+            if (global_diff_ < tolerance_ || k >= max_iterations_) {
+                break;
+            }
+        }
+        ++nstep;
+#pragma omp master
+        {
+            ++steps_;
+            iterations_ += k;
+        }
+
+        if (nstep % check_every_n_step_ == 0) {
+            double sum = 0.0;
+            for (int y = y_start; y < y_end; ++y) {
+                T const* p = p_.row(y);
+                T const* p_old = p_old_.row(y);
+                for (int x = 0; x < block_x_; ++x) {
+                    sum += std::fabs(p[x] - p_old[x]);
+                }
+            }
+            diff_[tid] = sum;
+#pragma omp barrier
+#pragma omp master
+            {
+                double local_sum = 0.0;
+                for (int i = 0; i < nthreads; ++i) {
+                    local_sum += diff_[i];
+                }
+                double total;
+                MPI_Allreduce(&local_sum, &total, 1, MPI_DOUBLE, MPI_SUM, comm_);
+                solve_end_ = M*total < C_s_*tau;
+                if (verbose && rank_ == 0) {
+                    std::cout << "Time step: " << std::setw(5) << nstep
+                              << ", iterations: " << std::setw(5) << k
+                              << ", diff = " << std::setw(12) << std::setprecision(5) << M*total
+                              << ", stop diff = " << std::setw(12) << std::setprecision(5) << C_s_*tau
+                              << "\r";
+                    std::cout.flush();
+                }
+            }
+#pragma omp barrier
+        }
+
+        if (save_images_ && nstep % save_every_n_step_ == 0) {
+#pragma omp master
+            save(nstep/save_every_n_step_);
+        }
+    } while (!solve_end_);
+}
+
+template class Phf_snakes_distributed<float>;
+template class Phf_snakes_distributed<double>;
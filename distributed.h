@@ -0,0 +1,107 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __DISTRIBUTED_H_INCLUDED__
+#define __DISTRIBUTED_H_INCLUDED__ 
+
+#include "array.h"
+#include "image_io.h"
+#include "sweep.h"
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <mpi.h>
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Segmentation of one image by the ranks of an MPI communicator. The ranks
+// form a two-dimensional Cartesian grid and each of them owns a block of the
+// image, stored in its own fields with one ghost row and column on every
+// side. The implicit system of a time step is solved by Gauss-Seidel with the
+// pixels coloured as a checkerboard: a pixel only reads pixels of the other
+// colour, so the ghosts of p are exchanged after every half-sweep. A rank
+// first updates the pixels of its block next to its neighbours, starts
+// sending them and updates the interior of the block while the messages are
+// under way. Within a rank the rows are shared by the OpenMP threads, of
+// which only the master thread calls MPI. The result does not depend on the
+// number of ranks or threads, except with the recursive smoothing filter.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Phf_snakes_distributed {
+public:
+    explicit Phf_snakes_distributed (MPI_Comm comm);
+    ~Phf_snakes_distributed ();
+
+    // Reads the parameters on every rank and only the window of the image
+    // around the block of the rank; rank 0 prepares the output directory.
+    void read (boost::property_tree::ptree const& pt);
+    // Runs the time steps until p is stationary. The snapshots of p are
+    // gathered on rank 0 and written as p-<n>.png, the last one always.
+    void solve ();
+
+    int threads;                // of every rank
+    bool verbose;               // print the settings and the progress on rank 0
+
+private:
+    void solve_thread (int tid, int nthreads);
+    double relax_edges (int color);
+    double relax_interior (int color, int y_start, int y_end);
+    void start_exchange ();
+    void finish_exchange ();
+    void reflect_boundary (Field<T>& f);
+    void save (int index);
+    void block_of (int rank, int& x0, int& y0, int& block_x, int& block_y) const;
+
+    MPI_Comm comm_;
+    int rank_, ranks_;
+    int dims_[2];               // of the grid of ranks, in y and x
+    int up_, down_, left_, right_;  // neighbouring ranks or MPI_PROC_NULL
+    std::vector<MPI_Request> requests_;
+    std::vector<T> send_left_, send_right_, recv_left_, recv_right_;
+
+    double C_s_, tolerance_;
+    int max_iterations_;
+    int check_every_n_step_;
+    int save_every_n_step_;
+    bool save_images_;
+    std::string image_name_;
+    std::string output_path_;
+    Png_options png_options_;
+    double h_;
+
+    int size_x_, size_y_;       // of the image
+    int x0_, y0_;               // of the first pixel of the block
+    int block_x_, block_y_;     // size of the block
+    Field<T> p_, p_old_, gradp_, gh_, gx_, gy_;
+    Sweep_grid<T> grid_;
+
+    std::vector<double> diff_;  // of the threads
+    double global_diff_;
+    bool solve_end_;
+    int steps_;
+    long iterations_;
+    double exchange_time_;      // waiting for the ghosts
+};
+
+#endif /* __DISTRIBUTED_H_INCLUDED__ */
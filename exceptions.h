@@ -37,5 +37,6 @@ struct png_io_error : virtual io_error {};
 struct wrong_signature_error : virtual shaperec_error {};
 struct wrong_header_error : virtual shaperec_error {};
 struct size_mismatch_error : virtual shaperec_error {};
+struct parameter_error : virtual shaperec_error {};
 
 #endif /* __EXCEPTIONS_H_INCLUDED__ */
@@ -0,0 +1,102 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+///////////////////////////////////////////////////////////////////////////////
+// Lists the frames of a file written with save_frames, or extracts one of
+// them as a PNG image or a gnuplot data file, chosen by the extension of the
+// output. A negative frame counts from the end. Usage:
+//
+//   phf-snakes-frames p-frames.phf
+//   phf-snakes-frames p-frames.phf frame output.png|output.dat
+///////////////////////////////////////////////////////////////////////////////
+
+#include "exceptions.h"
+#include "frames.h"
+#include "image_io.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+void list (Frame_reader const& reader) {
+    Frame_file_header const& hd = reader.header();
+    std::cout << "size         = " << hd.size_x << "x" << hd.size_y << " pixels of "
+              << (hd.scalar_size == sizeof(float) ? "float" : "double") << "\n"
+              << "level        = " << hd.level << "\n"
+              << "h            = " << hd.h << "\n"
+              << "tau          = " << hd.tau << "\n"
+              << "frames       = " << reader.frames() << (hd.deltas ? " (with deltas)" : "") << "\n"
+              << "\n   frame      step          time           tau  kind        bytes\n";
+    for (int k = 0; k < reader.frames(); ++k) {
+        Frame_header const& fh = reader.frame_header(k);
+        std::cout << std::setw(8) << k << std::setw(10) << fh.step
+                  << std::setw(14) << std::setprecision(6) << fh.time
+                  << std::setw(14) << std::setprecision(6) << fh.tau
+                  << std::setw(6) << (fh.kind == Frame_header::raw ? "raw" : "delta")
+                  << std::setw(13) << fh.size << "\n";
+    }
+    std::cout << "\nparameters:\n" << reader.parameters();
+}
+
+template <typename T>
+void extract (Frame_reader& reader, int k, std::string const& filename) {
+    Field<T> p;
+    reader.read(k, p);
+    if (filename.size() > 4 && filename.substr(filename.size() - 4) == ".dat") {
+        write_gnuplot(filename, p);
+    } else {
+        write_png(filename, p);
+    }
+}
+
+}
+
+int main (int ac, char* av[]) {
+    if (ac != 2 && ac != 4) {
+        std::cerr << "usage: " << av[0] << " frames.phf [frame output.png|output.dat]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    try {
+        Frame_reader reader(av[1]);
+        if (ac == 2) {
+            list(reader);
+            return EXIT_SUCCESS;
+        }
+        int k = std::atoi(av[2]);
+        if (k < 0) {
+            k += reader.frames();
+        }
+        if (k < 0 || k >= reader.frames())
+            BOOST_THROW_EXCEPTION(parameter_error() << string_info("no frame " + std::string(av[2])));
+        if (reader.header().scalar_size == sizeof(float)) {
+            extract<float>(reader, k, av[3]);
+        } else {
+            extract<double>(reader, k, av[3]);
+        }
+    }
+    catch (boost::exception & e) {
+        std::cerr << boost::diagnostic_information(e);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,300 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "exceptions.h"
+#include "frames.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+std::size_t const frame_alignment = 64;
+
+std::size_t align (std::size_t offset) {
+    return (offset + frame_alignment - 1)/frame_alignment*frame_alignment;
+}
+
+char const frames_magic[8] = {'P', 'H', 'F', 'R', 'A', 'M', 'E', 'S'};
+
+// Stores the exclusive or of the n values of width bytes at a and b into
+// out, byte k of every value in the k-th group of n bytes.
+void shuffle_xor (unsigned char const* a, unsigned char const* b, std::size_t n, std::size_t width, unsigned char* out) {
+    for (std::size_t k = 0; k < width; ++k) {
+        unsigned char* o = out + k*n;
+        for (std::size_t i = 0; i < n; ++i) {
+            o[i] = a[i*width + k] ^ b[i*width + k];
+        }
+    }
+}
+
+// Compresses size bytes at in into out, which holds out_size bytes, and
+// stores the compressed size there. Run-length encoding is enough for the
+// zero bytes of the delta frames and several times faster than the search
+// for repeated strings.
+bool compress_rle (Bytef const* in, uLong size, Bytef* out, uLongf& out_size) {
+    z_stream z;
+    std::memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, 1, Z_DEFLATED, 15, 8, Z_RLE) != Z_OK) {
+        return false;
+    }
+    z.next_in = const_cast<Bytef*>(in);
+    z.avail_in = size;
+    z.next_out = out;
+    z.avail_out = out_size;
+    int status = deflate(&z, Z_FINISH);
+    out_size = z.total_out;
+    deflateEnd(&z);
+    return status == Z_STREAM_END;
+}
+
+// Inverse of shuffle_xor: applies the bytes in, grouped as by shuffle_xor,
+// to the n values at a.
+void unshuffle_xor (unsigned char const* in, std::size_t n, std::size_t width, unsigned char* a) {
+    for (std::size_t k = 0; k < width; ++k) {
+        unsigned char const* c = in + k*n;
+        for (std::size_t i = 0; i < n; ++i) {
+            a[i*width + k] ^= c[i];
+        }
+    }
+}
+
+}
+
+template <typename T>
+Frame_writer<T>::Frame_writer (std::string const& filename, int size_x, int size_y, double h, double tau, int level,
+                               std::string const& parameters, bool deltas)
+    : filename_(filename)
+    , fd_(-1)
+    , map_(0)
+    , capacity_(0)
+    , size_x_(size_x)
+    , size_y_(size_y)
+    , deltas_(deltas)
+{
+    fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+        BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
+    std::size_t first_frame = align(sizeof(Frame_file_header) + parameters.size());
+    reserve(first_frame + 4*align(sizeof(Frame_header) + std::size_t(size_x)*size_y*sizeof(T)));
+    Frame_file_header& hd = header();
+    std::memset(&hd, 0, sizeof(hd));
+    std::memcpy(hd.magic, frames_magic, sizeof(hd.magic));
+    hd.version = 1;
+    hd.scalar_size = sizeof(T);
+    hd.size_x = size_x;
+    hd.size_y = size_y;
+    hd.level = level;
+    hd.deltas = deltas;
+    hd.h = h;
+    hd.tau = tau;
+    hd.frames = 0;
+    hd.parameters_size = parameters.size();
+    hd.first_frame = first_frame;
+    hd.end = first_frame;
+    std::copy(parameters.begin(), parameters.end(), map_ + sizeof(Frame_file_header));
+}
+
+template <typename T>
+Frame_writer<T>::~Frame_writer () {
+    std::size_t end = header().end;
+    munmap(map_, capacity_);
+    if (ftruncate(fd_, end) != 0) {
+        // The file is still readable, only longer than needed.
+    }
+    close(fd_);
+}
+
+// Returns the address of size more bytes at the end of the file, which
+// grows by at least half each time so that appending is amortized.
+template <typename T>
+char* Frame_writer<T>::reserve (std::size_t size) {
+    std::size_t end = map_ ? std::size_t(header().end) : 0;
+    if (end + size > capacity_) {
+        std::size_t capacity = std::max(end + size, capacity_ + capacity_/2);
+        if (map_) {
+            munmap(map_, capacity_);
+            map_ = 0;
+        }
+        if (ftruncate(fd_, capacity) != 0)
+            BOOST_THROW_EXCEPTION(io_error() << string_info("cannot extend " + filename_));
+        void* map = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED)
+            BOOST_THROW_EXCEPTION(io_error() << string_info("cannot map " + filename_));
+        map_ = static_cast<char*>(map);
+        capacity_ = capacity;
+    }
+    return map_ + end;
+}
+
+template <typename T>
+void Frame_writer<T>::append (Field<T> const& p, long step, double time, double tau) {
+    std::size_t n = std::size_t(size_x_)*size_y_;
+    std::size_t bytes = n*sizeof(T);
+    current_.resize(n);
+    for (int y = 0; y < size_y_; ++y) {
+        std::copy(p.row(y), p.row(y) + size_x_, &current_[std::size_t(y)*size_x_]);
+    }
+    bool delta = false;
+    uLongf data_size = bytes;
+    char* frame = 0;
+    if (deltas_ && !previous_.empty()) {
+        shuffled_.resize(bytes);
+        shuffle_xor(reinterpret_cast<unsigned char const*>(&current_[0]),
+                    reinterpret_cast<unsigned char const*>(&previous_[0]), n, sizeof(T), &shuffled_[0]);
+        uLongf bound = deflateBound(0, bytes);
+        frame = reserve(align(sizeof(Frame_header) + bound));
+        data_size = bound;
+        delta = compress_rle(&shuffled_[0], bytes, reinterpret_cast<Bytef*>(frame + sizeof(Frame_header)), data_size)
+                && data_size < bytes;
+    }
+    if (!delta) {
+        data_size = bytes;
+        frame = reserve(align(sizeof(Frame_header) + bytes));
+        std::memcpy(frame + sizeof(Frame_header), &current_[0], bytes);
+    }
+    std::size_t size = align(sizeof(Frame_header) + data_size);
+    Frame_header& fh = *reinterpret_cast<Frame_header*>(frame);
+    std::memset(&fh, 0, sizeof(fh));
+    fh.size = size;
+    fh.step = step;
+    fh.time = time;
+    fh.tau = tau;
+    fh.data_size = data_size;
+    fh.kind = delta ? Frame_header::delta : Frame_header::raw;
+    if (deltas_) {
+        previous_.swap(current_);
+    }
+    Frame_file_header& hd = header();
+    hd.end += size;
+    hd.frames += 1;
+}
+
+Frame_reader::Frame_reader (std::string const& filename)
+    : map_(0)
+    , size_(0)
+    , current_frame_(-1)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(Frame_file_header)) {
+        close(fd);
+        BOOST_THROW_EXCEPTION(wrong_header_error() << string_info(filename));
+    }
+    size_ = st.st_size;
+    void* map = mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        BOOST_THROW_EXCEPTION(file_read_error() << string_info(filename));
+    map_ = static_cast<char const*>(map);
+    Frame_file_header const& hd = header();
+    if (std::memcmp(hd.magic, frames_magic, sizeof(hd.magic)) != 0 || hd.version != 1) {
+        munmap(const_cast<char*>(map_), size_);
+        BOOST_THROW_EXCEPTION(wrong_signature_error() << string_info(filename));
+    }
+    std::size_t offset = hd.first_frame;
+    for (boost::uint64_t k = 0; k < hd.frames && offset + sizeof(Frame_header) <= size_; ++k) {
+        Frame_header const& fh = *reinterpret_cast<Frame_header const*>(map_ + offset);
+        if (fh.size < sizeof(Frame_header) || offset + fh.size > size_) {
+            break;
+        }
+        offsets_.push_back(offset);
+        offset += fh.size;
+    }
+}
+
+Frame_reader::~Frame_reader () {
+    munmap(const_cast<char*>(map_), size_);
+}
+
+std::string Frame_reader::parameters () const {
+    char const* text = map_ + sizeof(Frame_file_header);
+    return std::string(text, text + header().parameters_size);
+}
+
+template <typename T>
+void Frame_reader::check_scalar () const {
+    if (header().scalar_size != sizeof(T))
+        BOOST_THROW_EXCEPTION(size_mismatch_error() << string_info("frames of " + std::string(header().scalar_size == 4 ? "float" : "double")));
+}
+
+template <typename T>
+T const* Frame_reader::raw (int k) const {
+    check_scalar<T>();
+    if (frame_header(k).kind != Frame_header::raw) {
+        return 0;
+    }
+    return reinterpret_cast<T const*>(map_ + offsets_[k] + sizeof(Frame_header));
+}
+
+template <typename T>
+void Frame_reader::read (int k, Field<T>& p) {
+    check_scalar<T>();
+    int size_x = header().size_x;
+    int size_y = header().size_y;
+    std::size_t n = std::size_t(size_x)*size_y;
+    // The frames from the last raw one up to k, or from the cached one.
+    int first = k;
+    while (first > 0 && frame_header(first).kind != Frame_header::raw && first != current_frame_) {
+        --first;
+    }
+    current_.resize(n*sizeof(T));
+    T* current = reinterpret_cast<T*>(&current_[0]);
+    if (first != current_frame_) {
+        T const* values = raw<T>(first);
+        std::copy(values, values + n, current);
+    }
+    for (int j = first + 1; j <= k; ++j) {
+        Frame_header const& fh = frame_header(j);
+        char const* data = map_ + offsets_[j] + sizeof(Frame_header);
+        if (fh.kind == Frame_header::raw) {
+            T const* values = reinterpret_cast<T const*>(data);
+            std::copy(values, values + n, current);
+            continue;
+        }
+        shuffled_.resize(n*sizeof(T));
+        uLongf size = shuffled_.size();
+        if (uncompress(&shuffled_[0], &size, reinterpret_cast<Bytef const*>(data), fh.data_size) != Z_OK || size != shuffled_.size())
+            BOOST_THROW_EXCEPTION(file_read_error() << string_info("corrupt frame " + to_string(j)));
+        unshuffle_xor(&shuffled_[0], n, sizeof(T), reinterpret_cast<unsigned char*>(current));
+    }
+    current_frame_ = k;
+    p.resize(size_x, size_y);
+    for (int y = 0; y < size_y; ++y) {
+        std::copy(current + std::size_t(y)*size_x, current + std::size_t(y + 1)*size_x, p.row(y));
+    }
+    p.reflect_halo(0, size_y);
+}
+
+template class Frame_writer<float>;
+template class Frame_writer<double>;
+template float const* Frame_reader::raw (int) const;
+template double const* Frame_reader::raw (int) const;
+template void Frame_reader::read (int, Field<float>&);
+template void Frame_reader::read (int, Field<double>&);
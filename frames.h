@@ -0,0 +1,142 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __FRAMES_H_INCLUDED__
+#define __FRAMES_H_INCLUDED__ 
+
+#include "array.h"
+
+#include <boost/cstdint.hpp>
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Binary file of the frames of p of one run at full precision. The file
+// starts with a Frame_file_header, followed by the parameters of the run as
+// the text of phf-snakes.dat and by the frames, each a Frame_header and the
+// data. A raw frame stores the size_x*size_y values of p row by row. A delta
+// frame stores the bitwise exclusive or of the values with those of the
+// previous frame, with the bytes of equal significance of all values grouped
+// together and compressed by zlib: the sign, the exponent and the leading
+// bits of the mantissa change little between frames, so these groups shrink
+// to almost nothing, and the frame is still exact. A frame is stored raw if
+// the delta is not smaller; the first frame is always raw. Headers and frames
+// start at multiples of 64 bytes and all numbers are in the byte order of the
+// machine that wrote the file. The header is updated after every frame, so
+// the file is readable up to the last complete frame even if the run is
+// interrupted.
+///////////////////////////////////////////////////////////////////////////////
+
+struct Frame_file_header {
+    char magic[8];                  // "PHFRAMES"
+    boost::uint32_t version;        // 1
+    boost::uint32_t scalar_size;    // 4 for float, 8 for double
+    boost::int32_t size_x, size_y;
+    boost::int32_t level;           // of the pyramid
+    boost::uint32_t deltas;         // whether frames after the first may be deltas
+    double h, tau;
+    boost::uint64_t frames;
+    boost::uint64_t parameters_size;
+    boost::uint64_t first_frame;    // offset of the first frame
+    boost::uint64_t end;            // offset after the last frame
+    char reserved[48];
+};
+
+struct Frame_header {
+    enum { raw = 0, delta = 1 };
+    boost::uint64_t size;           // of the frame including this header
+    boost::int64_t step;
+    double time, tau;
+    boost::uint64_t data_size;      // bytes of data after this header
+    boost::uint32_t kind;
+    char reserved[20];
+};
+
+// Appends frames to a new file that it maps into memory, growing the file
+// and the mapping as needed. The file is truncated to its contents when the
+// writer is destroyed.
+template <typename T>
+class Frame_writer {
+public:
+    Frame_writer (std::string const& filename, int size_x, int size_y, double h, double tau, int level,
+                  std::string const& parameters, bool deltas);
+    ~Frame_writer ();
+
+    void append (Field<T> const& p, long step, double time, double tau);
+
+private:
+    Frame_writer (Frame_writer const&);
+    Frame_writer& operator= (Frame_writer const&);
+
+    char* reserve (std::size_t size);
+    Frame_file_header& header () { return *reinterpret_cast<Frame_file_header*>(map_); }
+
+    std::string filename_;
+    int fd_;
+    char* map_;
+    std::size_t capacity_;
+    int size_x_, size_y_;
+    bool deltas_;
+    std::vector<T> previous_, current_;
+    std::vector<unsigned char> shuffled_;
+};
+
+// Maps a file of frames read-only. Raw frames are accessed in place; delta
+// frames are applied to the previous frame, which is cached, so reading the
+// frames in order costs one pass over each.
+class Frame_reader {
+public:
+    explicit Frame_reader (std::string const& filename);
+    ~Frame_reader ();
+
+    Frame_file_header const& header () const { return *reinterpret_cast<Frame_file_header const*>(map_); }
+    std::string parameters () const;
+    int frames () const { return int(offsets_.size()); }
+    Frame_header const& frame_header (int k) const {
+        return *reinterpret_cast<Frame_header const*>(map_ + offsets_[k]);
+    }
+
+    // Returns the values of the raw frame k in place, or null for a delta
+    // frame. T has to be the scalar type of the file.
+    template <typename T>
+    T const* raw (int k) const;
+
+    // Stores the frame k into p.
+    template <typename T>
+    void read (int k, Field<T>& p);
+
+private:
+    Frame_reader (Frame_reader const&);
+    Frame_reader& operator= (Frame_reader const&);
+
+    template <typename T>
+    void check_scalar () const;
+
+    char const* map_;
+    std::size_t size_;
+    std::vector<std::size_t> offsets_;
+    std::vector<char> current_;     // the last frame read, as raw values
+    std::vector<unsigned char> shuffled_;
+    int current_frame_;
+};
+
+#endif /* __FRAMES_H_INCLUDED__ */
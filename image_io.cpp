@@ -22,8 +22,11 @@
 #include "exceptions.h"
 #include "image_io.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <vector>
 #include <png.h>
 #include <zlib.h>
 
@@ -51,7 +54,8 @@ std::istream& eatcomment (std::istream& s) {
     return s;
 }
 
-void read_pgm (std::string const& filename, array_t& image) {
+template <typename T>
+void read_pgm (std::string const& filename, Field<T>& image) {
     std::ifstream file(filename.c_str());
     if (file.fail())
         BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
@@ -65,59 +69,63 @@ void read_pgm (std::string const& filename, array_t& image) {
     eatcomment(file) >> size_x;
     eatcomment(file) >> size_y;
     eatcomment(file) >> maxval;
-    image.resize(boost::extents[size_x][size_y]);
+    image.resize(size_x, size_y);
     eatwhite(file);
-    boost::multi_array<unsigned char,2> raw_data(boost::extents[size_x][size_y]);
-    if (not file.read((char*)raw_data.data(), (size_x*size_y)))
+    std::vector<unsigned char> raw_data(size_x*size_y);
+    if (not file.read((char*)&raw_data[0], (size_x*size_y)))
         BOOST_THROW_EXCEPTION(file_read_error() << string_info(filename));
     file.close();
 
     for (int jy = 0; jy != size_y; jy++) {
+        T* r = image.row(jy);
         for (int jx = 0; jx != size_x; jx++) {
-            image[jx][jy] = raw_data[jx][jy]/(double)maxval;
+            r[jx] = raw_data[jy*size_x + jx]/(double)maxval;
         }
     }
 }
 
-void write_pgm(std::string const& filename, array_t const& a) {
+template <typename T>
+void write_pgm(std::string const& filename, Field<T> const& a) {
     std::ofstream file(filename.c_str());
     if (file.fail())
         BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
-    int size_x = a.shape()[0];
-    int size_y = a.shape()[1];
+    int size_x = a.size_x();
+    int size_y = a.size_y();
 
     file << "P5\n";
     file << size_x << " " << size_y << std::endl;
     file << 255 << std::endl;
 
-    boost::multi_array<unsigned char,2> raw_data(boost::extents[size_x][size_y]);
+    std::vector<unsigned char> raw_data(size_x*size_y);
     for (int jy = 0; jy != size_y; ++jy) {
+        T const* r = a.row(jy);
         for (int jx = 0; jx != size_x; ++jx) {
-            if (a[jx][jy] > 1.0) {
-                raw_data[jx][jy] = 255;
+            if (r[jx] > 1.0) {
+                raw_data[jy*size_x + jx] = 255;
             } else {
-                if (a[jx][jy] < 0.0) {
-                    raw_data[jx][jy] = 0;
+                if (r[jx] < 0.0) {
+                    raw_data[jy*size_x + jx] = 0;
                 } else {
-                    raw_data[jx][jy] = 255*a[jx][jy];
+                    raw_data[jy*size_x + jx] = 255*r[jx];
                 }
             }
         }
     }
-    file.write((char const*)raw_data.data(), size_x*size_y);
+    file.write((char const*)&raw_data[0], size_x*size_y);
 }
 
-void write_gnuplot(std::string const& filename, array_t const& a) {
+template <typename T>
+void write_gnuplot(std::string const& filename, Field<T> const& a) {
     std::ofstream file(filename.c_str());
     if (file.fail())
         BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
     file.setf(std::ios::scientific);
 
-    int size_x = a.shape()[0];
-    int size_y = a.shape()[1];
+    int size_x = a.size_x();
+    int size_y = a.size_y();
     for (int jx = 0; jx != size_x; ++jx) {
         for (int jy = 0; jy != size_y; ++jy) {
-            file << std::setw(12) << std::setprecision(5) << a[size_x-jx-1][jy] << std::endl;
+            file << std::setw(12) << std::setprecision(5) << a(size_x-jx-1, jy) << std::endl;
         }
         file << std::endl;
     }      
@@ -132,7 +140,15 @@ void print_png_version_info () {
         << ".\n";
 }
 
-void read_png (std::string const& filename, array_t& image) {
+template <typename T>
+void read_png (std::string const& filename, Field<T>& image) {
+    read_png(filename, image, 0, 0, -1, -1);
+}
+
+// The rows are decoded one at a time, so only the window is ever held in
+// memory; the rows below the window are not decoded at all.
+template <typename T>
+void read_png (std::string const& filename, Field<T>& image, int x0, int y0, int size_x, int size_y) {
     FILE *file = fopen(filename.c_str(), "rb");
     if (file == NULL) {
         BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
@@ -208,24 +224,90 @@ void read_png (std::string const& filename, array_t& image) {
     // int number_of_passes = png_set_interlace_handling(png_ptr);
     png_read_update_info(png_ptr, info_ptr);
 
-    image.resize(boost::extents[width][height]);
     int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
     if (rowbytes != width) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(file);
         BOOST_THROW_EXCEPTION(png_io_error() << string_info("size mismatch"));
     }
-    boost::multi_array<png_byte,1> row(boost::extents[rowbytes]);
-    for (int j = 0; j != height; ++j) {
-        png_read_row(png_ptr, row.data(), NULL);
-        for (int i = 0; i != rowbytes; ++i) {
-            image[i][j] = row[i]/255.0;
+    if (size_x < 0) {
+        size_x = width;
+        size_y = height;
+    }
+    if (x0 < 0 || y0 < 0 || size_x < 1 || size_y < 1 || x0 + size_x > int(width) || y0 + size_y > int(height)) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(file);
+        BOOST_THROW_EXCEPTION(png_io_error() << string_info("the window does not fit in " + filename));
+    }
+    image.resize(size_x, size_y);
+    std::vector<png_byte> row(rowbytes);
+    for (int j = 0; j != y0 + size_y; ++j) {
+        png_read_row(png_ptr, &row[0], NULL);
+        if (j < y0) {
+            continue;
+        }
+        T* r = image.row(j - y0);
+        for (int i = 0; i != size_x; ++i) {
+            r[i] = row[x0 + i]/255.0;
         }
     }
-    png_read_end(png_ptr, end_info);
+    if (y0 + size_y == int(height)) {
+        png_read_end(png_ptr, end_info);
+    }
     png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
     fclose(file);
 }
 
-void write_png(std::string const& filename, array_t const& image) {
+void read_png_size (std::string const& filename, int& size_x, int& size_y) {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
+    }
+    // The signature is followed by the IHDR chunk: its length, its type and
+    // the width and the height as big-endian 32-bit integers.
+    unsigned char header[24];
+    std::size_t n = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    if (n != sizeof(header) || png_sig_cmp(header, 0, 8) || std::memcmp(header + 12, "IHDR", 4) != 0) {
+        BOOST_THROW_EXCEPTION(png_io_error() << string_info("bad signature"));
+    }
+    size_x = png_get_uint_32(header + 16);
+    size_y = png_get_uint_32(header + 20);
+}
+
+namespace {
+
+int png_filters (std::string const& name) {
+    if (name == "none")    return PNG_FILTER_NONE;
+    if (name == "sub")     return PNG_FILTER_SUB;
+    if (name == "up")      return PNG_FILTER_UP;
+    if (name == "average") return PNG_FILTER_AVG;
+    if (name == "paeth")   return PNG_FILTER_PAETH;
+    return PNG_ALL_FILTERS;
+}
+
+// Maps [0, 1] to 0 to 255, clamping the values outside. The clamping is done
+// on the integers, which the compiler vectorizes, unlike comparisons of
+// floating point numbers that may trap; p stays close to [0, 1], far within
+// the range of int.
+template <typename T>
+void quantize_row (T const* r, png_bytep row, int width) {
+    for (int i = 0; i < width; ++i) {
+        int pixel = int(r[i]*255.0);
+        row[i] = png_byte(std::min(std::max(pixel, 0), 255));
+    }
+}
+
+}
+
+bool is_png_filter (std::string const& name) {
+    return name == "none" || name == "sub" || name == "up" || name == "average" || name == "paeth" || name == "adaptive";
+}
+
+// The whole image is quantized to 8 bits first and then handed to libpng at
+// once.
+template <typename T>
+void write_png(std::string const& filename, Field<T> const& image, Png_options const& options) {
     FILE* file = fopen(filename.c_str(), "wb");
     if (file == NULL) {
         BOOST_THROW_EXCEPTION(png_io_error());
@@ -245,32 +327,46 @@ void write_png(std::string const& filename, array_t const& image) {
     }
 
     png_init_io(png_ptr, file);
+    if (options.compression >= 0) {
+        png_set_compression_level(png_ptr, options.compression);
+    }
+    if (options.compression == 0) {
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+    } else if (options.filter != "adaptive") {
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, png_filters(options.filter));
+    }
 
-    png_uint_32 width = image.shape()[0];
-    png_uint_32 height = image.shape()[1];
+    png_uint_32 width = image.size_x();
+    png_uint_32 height = image.size_y();
 
     png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
             PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
     png_write_info(png_ptr, info_ptr);
 
-    boost::multi_array<png_byte,1> row(boost::extents[width]);
-    for (int j = 0; j != height; ++j) {
-        for (int i = 0; i != row.shape()[0]; ++i) {
-            double pixel = image[i][j];
-            if (pixel < 0.0) {
-                row[i] = 0;
-            } else if (pixel > 1.0) {
-                row[i] = 255;
-            } else {
-                row[i] = (png_byte)(image[i][j]*255.0);
-            }
-        }
-        png_write_row(png_ptr, row.data());
+    std::vector<png_byte> pixels(std::size_t(width)*height);
+    std::vector<png_bytep> rows(height);
+    for (png_uint_32 j = 0; j != height; ++j) {
+        rows[j] = &pixels[std::size_t(j)*width];
+        quantize_row(image.row(j), rows[j], width);
     }
+    png_write_image(png_ptr, &rows[0]);
 
     png_write_end(png_ptr, NULL);
     png_destroy_write_struct(&png_ptr, &info_ptr);
     fclose(file);
 }
 
+
+template void read_pgm      (std::string const&, Field<float>&);
+template void read_pgm      (std::string const&, Field<double>&);
+template void read_png      (std::string const&, Field<float>&);
+template void read_png      (std::string const&, Field<double>&);
+template void read_png      (std::string const&, Field<float>&, int, int, int, int);
+template void read_png      (std::string const&, Field<double>&, int, int, int, int);
+template void write_pgm     (std::string const&, Field<float> const&);
+template void write_pgm     (std::string const&, Field<double> const&);
+template void write_png     (std::string const&, Field<float> const&, Png_options const&);
+template void write_png     (std::string const&, Field<double> const&, Png_options const&);
+template void write_gnuplot (std::string const&, Field<float> const&);
+template void write_gnuplot (std::string const&, Field<double> const&);
@@ -25,12 +25,33 @@
 #include "array.h"
 #include "utils.h"
 
-void read_pgm      (std::string const& filename, array_t&       image);
-void read_png      (std::string const& filename, array_t&       image);
+// The readers and writers are instantiated for fields of float and double.
+template <typename T>
+void read_pgm      (std::string const& filename, Field<T>&       image);
+template <typename T>
+void read_png      (std::string const& filename, Field<T>&       image);
+// Reads the window of size_x by size_y pixels whose top left corner is
+// (x0, y0), or the whole image if size_x is negative.
+template <typename T>
+void read_png      (std::string const& filename, Field<T>&       image, int x0, int y0, int size_x, int size_y);
+// Reads only the size of the image from the header of the PNG file.
+void read_png_size (std::string const& filename, int& size_x, int& size_y);
 void print_png_version_info ();
 
-void write_pgm     (std::string const& filename, array_t const& image);
-void write_png     (std::string const& filename, array_t const& image);
-void write_gnuplot (std::string const& filename, array_t const& image);
+template <typename T>
+void write_pgm     (std::string const& filename, Field<T> const& image);
+// Settings of the zlib compression and of the row filters of write_png.
+// Level 0 stores the image uncompressed and then never filters the rows.
+struct Png_options {
+    Png_options () : compression(-1), filter("adaptive") { }
+    int compression;        // 0 to 9, or -1 for the default of zlib
+    std::string filter;     // none, sub, up, average, paeth or adaptive
+};
+bool is_png_filter (std::string const& name);
+
+template <typename T>
+void write_png     (std::string const& filename, Field<T> const& image, Png_options const& options = Png_options());
+template <typename T>
+void write_gnuplot (std::string const& filename, Field<T> const& image);
 
 #endif /* __IMAGE_IO_H_INCLUDED__ */
@@ -0,0 +1,218 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+///////////////////////////////////////////////////////////////////////////////
+// Compares the throughput of one red-black Gauss-Seidel sweep of the
+// phase-field equation on the column-major boost::multi_array layout, that
+// the solver used before, with the row-contiguous field_t. Usage:
+//
+//   phf-snakes-layout-bench [size ...]
+///////////////////////////////////////////////////////////////////////////////
+
+#include "array.h"
+
+#include <boost/multi_array.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sys/time.h>
+
+namespace {
+
+typedef boost::multi_array<double, 2> multi_array_t;
+
+double const tau = 0.5e-4;
+double const h_pow2_inv = 1.0e4;
+double const xi = 0.01;
+double const a = 2.0;
+double const F = 40.0;
+
+double f0 (double s) {
+    return -a*s*(s - 1)*(s - 0.5);
+}
+
+double wall_time () {
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+double initial_value (int x, int y, int size_x, int size_y) {
+    double dx = x - 0.5*size_x;
+    double dy = y - 0.5*size_y;
+    return (dx*dx + dy*dy < 0.1*size_x*size_y) ? 1.0 : 0.0;
+}
+
+double coefficient (int x, int y) {
+    return 0.5 + 0.25*std::sin(0.1*x)*std::cos(0.1*y);
+}
+
+struct Multi_array_problem {
+    Multi_array_problem (int size_x, int size_y)
+        : size_x(size_x), size_y(size_y)
+        , p(boost::extents[size_x][size_y]), p_old(boost::extents[size_x][size_y])
+        , gx(boost::extents[size_x-1][size_y]), gy(boost::extents[size_x][size_y-1])
+        , gh(boost::extents[size_x][size_y]), gradp(boost::extents[size_x][size_y])
+    {
+        for (int x = 0; x < size_x; ++x) {
+            for (int y = 0; y < size_y; ++y) {
+                p[x][y] = p_old[x][y] = initial_value(x, y, size_x, size_y);
+                gh[x][y] = gradp[x][y] = coefficient(x, y);
+                if (x < size_x-1) gx[x][y] = coefficient(x, y);
+                if (y < size_y-1) gy[x][y] = coefficient(x, y);
+            }
+        }
+    }
+
+    double sweep (int parity) {
+        double local_diff = 0.0;
+        for (int y = parity; y < size_y; y+=2) {
+            for (int x = 0; x < size_x; x++) {
+                double pp = p[x][y];
+                double lp = (x == 0)        ? p[1][y]        : p[x-1][y];
+                double rp = (x == size_x-1) ? p[size_x-2][y] : p[x+1][y];
+                double dp = (y == 0)        ? p[x][1]        : p[x][y-1];
+                double up = (y == size_y-1) ? p[x][size_y-2] : p[x][y+1];
+                double gp = gradp[x][y];
+
+                double gg = gh[x][y];
+                double lg = (x == 0)        ? gx[0][y]        : gx[x-1][y];
+                double rg = (x == size_x-1) ? gx[size_x-2][y] : gx[x][y];
+                double dg = (y == 0)        ? gy[x][0]        : gy[x][y-1];
+                double ug = (y == size_y-1) ? gy[x][size_y-2] : gy[x][y];
+
+                double sum = p_old[x][y] + tau * gg * F * gp;
+                sum += tau/xi/xi * gg * f0(pp);
+                sum += tau*h_pow2_inv*(lg*lp + dg*dp);
+                sum += tau*h_pow2_inv*(rg*rp + ug*up);
+                sum /= (1.0 + tau*h_pow2_inv*(rg+lg+ug+dg));
+
+                local_diff = std::max(local_diff, std::fabs(pp-sum));
+                p[x][y] = sum;
+            }
+        }
+        return local_diff;
+    }
+
+    int size_x, size_y;
+    multi_array_t p, p_old, gx, gy, gh, gradp;
+};
+
+struct Field_problem {
+    Field_problem (int size_x, int size_y)
+        : size_x(size_x), size_y(size_y)
+        , p(size_x, size_y), p_old(size_x, size_y), gx(size_x, size_y)
+        , gy(size_x, size_y), gh(size_x, size_y), gradp(size_x, size_y)
+    {
+        for (int y = -1; y <= size_y; ++y) {
+            for (int x = -1; x <= size_x; ++x) {
+                p(x, y) = p_old(x, y) = initial_value(x, y, size_x, size_y);
+                gh(x, y) = gradp(x, y) = gx(x, y) = gy(x, y) = coefficient(x, y);
+            }
+        }
+    }
+
+    double sweep (int parity) {
+        double local_diff = 0.0;
+        for (int y = parity; y < size_y; y+=2) {
+            double* pr = p.row(y);
+            double const* pd = p.row(y-1);
+            double const* pu = p.row(y+1);
+            double const* po = p_old.row(y);
+            double const* gxr = gx.row(y);
+            double const* gyd = gy.row(y-1);
+            double const* gyu = gy.row(y);
+            double const* ghr = gh.row(y);
+            double const* gpr = gradp.row(y);
+            for (int x = 0; x < size_x; x++) {
+                double pp = pr[x];
+                double gg = ghr[x];
+                double lg = gxr[x-1];
+                double rg = gxr[x];
+                double dg = gyd[x];
+                double ug = gyu[x];
+
+                double sum = po[x] + tau * gg * F * gpr[x];
+                sum += tau/xi/xi * gg * f0(pp);
+                sum += tau*h_pow2_inv*(lg*pr[x-1] + dg*pd[x]);
+                sum += tau*h_pow2_inv*(rg*pr[x+1] + ug*pu[x]);
+                sum /= (1.0 + tau*h_pow2_inv*(rg+lg+ug+dg));
+
+                local_diff = std::max(local_diff, std::fabs(pp-sum));
+                pr[x] = sum;
+            }
+        }
+        return local_diff;
+    }
+
+    int size_x, size_y;
+    field_t p, p_old, gx, gy, gh, gradp;
+};
+
+// Returns the number of pixel updates per second.
+template <typename Problem>
+double measure (int size) {
+    Problem problem(size, size);
+    double checksum = 0.0;
+    int nsweeps = 0;
+    double start = wall_time();
+    double elapsed;
+    do {
+        checksum += problem.sweep(0);
+        checksum += problem.sweep(1);
+        ++nsweeps;
+        elapsed = wall_time() - start;
+    } while (elapsed < 1.0);
+    if (checksum < 0.0) {
+        std::cout << checksum;
+    }
+    return double(nsweeps)*size*size/elapsed;
+}
+
+}
+
+int main (int ac, char* av[]) {
+    std::vector<int> sizes;
+    for (int i = 1; i < ac; ++i) {
+        sizes.push_back(std::atoi(av[i]));
+    }
+    if (sizes.empty()) {
+        sizes.push_back(256);
+        sizes.push_back(1024);
+        sizes.push_back(2048);
+    }
+
+    std::cout << std::setw(8) << "size"
+              << std::setw(20) << "multi_array [Mpx/s]"
+              << std::setw(20) << "field_t [Mpx/s]"
+              << std::setw(10) << "speedup" << std::endl;
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        double old_rate = measure<Multi_array_problem>(sizes[i]);
+        double new_rate = measure<Field_problem>(sizes[i]);
+        std::cout << std::setw(8) << sizes[i]
+                  << std::setw(20) << std::setprecision(4) << old_rate*1.0e-6
+                  << std::setw(20) << std::setprecision(4) << new_rate*1.0e-6
+                  << std::setw(10) << std::setprecision(3) << new_rate/old_rate << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
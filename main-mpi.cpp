@@ -0,0 +1,91 @@
+//
+//  Copyright (c) 2008-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "data.h"
+#include "distributed.h"
+#include "exceptions.h"
+
+#include <boost/property_tree/info_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <mpi.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Runs the segmentation of the parameters with the fields stored in T.
+template <typename T>
+void run (boost::property_tree::ptree const& pt, int threads, bool verbose)
+{
+    Phf_snakes_distributed<T> problem(MPI_COMM_WORLD);
+    problem.threads = threads;
+    problem.verbose = verbose;
+    problem.read(pt);
+    problem.solve();
+}
+
+int main(int ac, char* av[])
+{
+    int provided;
+    MPI_Init_thread(&ac, &av, MPI_THREAD_FUNNELED, &provided);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0) {
+        std::cout << "phf-snakes 1.0 http://github.com/vladimir-ch/phf-snakes/\nCopyright (c) 2008-2012 Vladimir Chalupecky\n";
+    }
+    if (ac != 1) {
+        if (rank == 0) {
+            std::cerr << "usage: mpirun -np N phf-snakes-mpi\n";
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    // Only the master thread of a rank calls MPI, so the threads need no
+    // more than MPI_THREAD_FUNNELED.
+    int threads = 1;
+#ifdef _OPENMP
+    if (provided >= MPI_THREAD_FUNNELED) {
+        threads = omp_get_max_threads();
+    }
+#endif
+
+    try {
+        boost::property_tree::ptree pt;
+        read_info("phf-snakes.dat", pt);
+        if (read_precision(pt) == "float") {
+            run<float>(pt, threads, rank == 0);
+        } else {
+            run<double>(pt, threads, rank == 0);
+        }
+    }
+    catch (boost::exception & e) {
+        std::cerr << boost::diagnostic_information(e);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
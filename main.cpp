@@ -0,0 +1,104 @@
+//
+//  Copyright (c) 2008-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "batch.h"
+#include "data.h"
+#include "exceptions.h"
+#include "phf-snakes.h"
+#include "trace.h"
+#include "volume.h"
+
+#include <boost/property_tree/info_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Runs the segmentation of the parameter file with the fields stored in T
+// and all threads.
+template <typename T>
+int run (std::string const& filename)
+{
+    Phf_snakes_data<T> shared_data;
+#ifdef _OPENMP
+    shared_data.threads = omp_get_max_threads();
+#endif
+
+    try {
+        boost::property_tree::ptree pt;
+        read_info(filename, pt);
+        if (pt.get<bool>("volume.enabled", false)) {
+            Phf_snakes_volume<T> volume;
+            volume.threads = shared_data.threads;
+            volume.read(pt);
+            volume.solve();
+            return EXIT_SUCCESS;
+        }
+        shared_data.read(pt);
+        do {
+            solve_levels(shared_data);
+        } while (shared_data.next_frame());
+        if (shared_data.arena) {
+            std::cout << shared_data.memory_summary() << std::endl;
+        }
+#ifdef PHF_TRACE
+        trace_write(shared_data.output_path + "trace.json");
+        trace_summary(std::cout);
+#endif
+    }
+    catch (boost::exception & e) {
+        std::cerr << boost::diagnostic_information(e);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int ac, char* av[])
+{
+    std::cout << "phf-snakes 1.0 http://github.com/vladimir-ch/phf-snakes/\nCopyright (c) 2008-2012 Vladimir Chalupecky\n";
+
+    if (ac == 3 && std::string(av[1]) == "--batch") {
+        return run_batch(av[2], "phf-snakes.dat");
+    }
+    if (ac != 1) {
+        std::cerr << "usage: phf-snakes [--batch manifest]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string precision;
+    try {
+        precision = read_precision("phf-snakes.dat");
+    }
+    catch (boost::exception & e) {
+        std::cerr << boost::diagnostic_information(e);
+        return EXIT_FAILURE;
+    }
+
+    if (precision == "float") {
+        return run<float>("phf-snakes.dat");
+    }
+    return run<double>("phf-snakes.dat");
+}
@@ -0,0 +1,327 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "multigrid.h"
+#include "utils.h"
+
+#include <algorithm>
+
+namespace {
+
+// Mean of the (up to) 2x2 pixels of f that are merged into the coarse pixel
+// (I,J).
+template <typename T>
+double block_mean (Field<T> const& f, int I, int J, int size_x, int size_y) {
+    int x0 = 2*I, x1 = std::min(2*I + 1, size_x - 1);
+    int y0 = 2*J, y1 = std::min(2*J + 1, size_y - 1);
+    return 0.25*(f(x0, y0) + f(x1, y0) + f(x0, y1) + f(x1, y1));
+}
+
+// Effective coefficient of the three fine edges g0, g1, g2 that lie between
+// the centres of two neighbouring coarse pixels; the outer two are crossed
+// only halfway.
+double series (double g0, double g1, double g2) {
+    return 2.0/(0.5/g0 + 1.0/g1 + 0.5/g2);
+}
+
+// Copies the row y_from of from, including the halo, to the row y_to of to.
+template <typename T>
+void copy_row (Field<T> const& from, int y_from, Field<T>& to, int y_to) {
+    std::copy(from.row(y_from) - 1, from.row(y_from) + from.size_x() + 1, to.row(y_to) - 1);
+}
+
+// Mirrors the rows next to the boundary into the ghost rows, if the thread
+// owns the first or the last row.
+template <typename T>
+void reflect_ghost_rows (Field<T>& f, int y_start, int y_end) {
+    int size_y = f.size_y();
+    if (y_start == 0 && y_end > 0) {
+        copy_row(f, 1, f, -1);
+    }
+    if (y_end == size_y && y_start < y_end) {
+        copy_row(f, size_y-2, f, size_y);
+    }
+}
+
+}
+
+template <typename T>
+void Multigrid<T>::setup (Sweep_grid<T> const& fine, Multigrid_settings const& settings, int nthreads) {
+    settings_ = settings;
+    int nlevels = 1;
+    int nx = fine.size_x;
+    int ny = fine.size_y;
+    // The smoother treats the reaction term explicitly, its update contracts
+    // only while tau/xi^2*|f0'| < 1 + tau/h^2*(sum of g). A coarse grid is
+    // used only while the contraction factor stays below 3/4 there, i.e.,
+    // while the grid still resolves the width xi of the interface. Since
+    // |f0'| <= a/2 on [0,1] and 4/H^2 = 1/h^2 for the coarse grid:
+    Sweep_parameters const& c = fine.parameters;
+    double reaction = c.tau/c.xi/c.xi*c.a/2.0;
+    double h_pow2_inv = c.h_pow2_inv;
+    int min_size = std::max(settings_.coarsest_size, 3);
+    while (std::min(nx, ny) >= 2*min_size && reaction <= 0.75*(1.0 + c.tau*h_pow2_inv)) {
+        nx = (nx + 1)/2;
+        ny = (ny + 1)/2;
+        h_pow2_inv /= 4.0;
+        ++nlevels;
+    }
+
+    levels_.resize(nlevels);
+    levels_[0].grid = fine;
+    levels_[0].residual.resize(fine.size_x, fine.size_y, nthreads);
+    for (int l = 1; l < nlevels; ++l) {
+        Level& c = levels_[l];
+        Sweep_grid<T> const& f = levels_[l-1].grid;
+        nx = (f.size_x + 1)/2;
+        ny = (f.size_y + 1)/2;
+        c.p.resize(nx, ny, nthreads);
+        c.p_restricted.resize(nx, ny, nthreads);
+        c.rhs.resize(nx, ny, nthreads);
+        c.residual.resize(nx, ny, nthreads);
+        c.gradp.resize(nx, ny, nthreads);
+        c.gh.resize(nx, ny, nthreads);
+        c.gx.resize(nx, ny, nthreads);
+        c.gy.resize(nx, ny, nthreads);
+
+        c.grid.size_x = nx;
+        c.grid.size_y = ny;
+        c.grid.p      = &c.p;
+        c.grid.p_old  = &c.rhs;
+        c.grid.gradp  = &c.gradp;
+        c.grid.gh     = &c.gh;
+        c.grid.gx     = &c.gx;
+        c.grid.gy     = &c.gy;
+        c.grid.band   = 0;
+        c.grid.parameters = f.parameters;
+        c.grid.parameters.h_pow2_inv = f.parameters.h_pow2_inv/4.0;
+        c.grid.parameters.F = 0.0;
+        coarsen_coefficients(l);
+    }
+}
+
+template <typename T>
+void Multigrid<T>::coarsen_coefficients (int l) {
+    Sweep_grid<T> const& f = levels_[l-1].grid;
+    Level& c = levels_[l];
+    int nx = c.grid.size_x;
+    int ny = c.grid.size_y;
+    Field<T> const& gx = *f.gx;
+    Field<T> const& gy = *f.gy;
+
+    for (int J = 0; J < ny; ++J) {
+        int y0 = 2*J, y1 = std::min(2*J + 1, f.size_y - 1);
+        for (int I = 0; I < nx; ++I) {
+            c.gh(I, J) = block_mean(*f.gh, I, J, f.size_x, f.size_y);
+        }
+        for (int I = 0; I < nx-1; ++I) {
+            int x = 2*I;
+            c.gx(I, J) = 0.5*(series(gx(x, y0), gx(x+1, y0), gx(x+2, y0))
+                            + series(gx(x, y1), gx(x+1, y1), gx(x+2, y1)));
+        }
+        c.gx(-1, J) = c.gx(0, J);
+        c.gx(nx-1, J) = c.gx(nx-2, J);
+    }
+
+    for (int J = 0; J < ny-1; ++J) {
+        int y = 2*J;
+        for (int I = 0; I < nx; ++I) {
+            int x0 = 2*I, x1 = std::min(2*I + 1, f.size_x - 1);
+            c.gy(I, J) = 0.5*(series(gy(x0, y), gy(x0, y+1), gy(x0, y+2))
+                            + series(gy(x1, y), gy(x1, y+1), gy(x1, y+2)));
+        }
+    }
+    std::copy(c.gy.row(0), c.gy.row(0) + nx, c.gy.row(-1));
+    std::copy(c.gy.row(ny-2), c.gy.row(ny-2) + nx, c.gy.row(ny-1));
+}
+
+template <typename T>
+double Multigrid<T>::cycle (relax_row_fn kernel, bool full, int tid, int nthreads) {
+    int coarsest = levels() - 1;
+    if (coarsest == 0) {
+        return smooth(0, 1, kernel, tid, nthreads);
+    }
+    if (full && settings_.cycle == "FMG") {
+        for (int l = 0; l < coarsest; ++l) {
+            restrict_rhs(l, tid, nthreads);
+        }
+        smooth(coarsest, settings_.coarsest_sweeps, kernel, tid, nthreads);
+        for (int l = coarsest-1; l > 0; --l) {
+            correct(l, tid, nthreads);
+            v_cycle(l, kernel, tid, nthreads);
+        }
+        correct(0, tid, nthreads);
+    }
+    return v_cycle(0, kernel, tid, nthreads);
+}
+
+template <typename T>
+double Multigrid<T>::smooth (int l, int nsweeps, relax_row_fn kernel, int tid, int nthreads) {
+    Sweep_grid<T> const& grid = levels_[l].grid;
+    int y_start, y_end;
+    split_rows(grid.size_y, tid, nthreads, y_start, y_end);
+    double local_diff = 0.0;
+    for (int k = 0; k < nsweeps; ++k) {
+        local_diff = relax_rows(grid, kernel, 0, y_start, y_end);
+#pragma omp barrier
+        local_diff = std::max(local_diff, relax_rows(grid, kernel, 1, y_start, y_end));
+#pragma omp barrier
+    }
+    return local_diff;
+}
+
+template <typename T>
+double Multigrid<T>::v_cycle (int l, relax_row_fn kernel, int tid, int nthreads) {
+    smooth(l, settings_.pre_smoothing, kernel, tid, nthreads);
+    restrict_residual(l, tid, nthreads);
+    if (l + 1 == levels() - 1) {
+        smooth(l + 1, settings_.coarsest_sweeps, kernel, tid, nthreads);
+    } else {
+        v_cycle(l + 1, kernel, tid, nthreads);
+    }
+    correct(l, tid, nthreads);
+    return smooth(l, settings_.post_smoothing, kernel, tid, nthreads);
+}
+
+// Restricts p and the residual of the grid l to the grid l+1 and sets the
+// right-hand side there so that the restricted p is corrected by the error
+// of the coarse grid (full approximation scheme).
+template <typename T>
+void Multigrid<T>::restrict_residual (int l, int tid, int nthreads) {
+    Level& f = levels_[l];
+    Level& c = levels_[l+1];
+    int y_start, y_end;
+
+    split_rows(f.grid.size_y, tid, nthreads, y_start, y_end);
+    for (int y = y_start; y < y_end; ++y) {
+        Row_stencil<T> s = f.grid.stencil(y);
+        T* r = f.residual.row(y);
+        for (int x = 0; x < f.grid.size_x; ++x) {
+            r[x] = rhs_point(s, f.grid.parameters, x) - operator_point(s, f.grid.parameters, x);
+        }
+    }
+#pragma omp barrier
+    split_rows(c.grid.size_y, tid, nthreads, y_start, y_end);
+    for (int J = y_start; J < y_end; ++J) {
+        for (int I = 0; I < c.grid.size_x; ++I) {
+            c.p_restricted(I, J) = block_mean(*f.grid.p, I, J, f.grid.size_x, f.grid.size_y);
+            c.rhs(I, J) = block_mean(f.residual, I, J, f.grid.size_x, f.grid.size_y);
+        }
+        c.p_restricted.reflect_row_halo(J);
+    }
+#pragma omp barrier
+    reflect_ghost_rows(c.p_restricted, y_start, y_end);
+#pragma omp barrier
+    Sweep_grid<T> restricted = c.grid;
+    restricted.p = &c.p_restricted;
+    for (int J = y_start; J < y_end; ++J) {
+        Row_stencil<T> s = restricted.stencil(J);
+        T* r = c.rhs.row(J);
+        for (int I = 0; I < c.grid.size_x; ++I) {
+            r[I] += operator_point(s, c.grid.parameters, I);
+        }
+        copy_row(c.p_restricted, J, c.p, J);
+    }
+    if (y_start == 0 && y_end > 0) {
+        copy_row(c.p_restricted, -1, c.p, -1);
+    }
+    if (y_end == c.grid.size_y && y_start < y_end) {
+        copy_row(c.p_restricted, c.grid.size_y, c.p, c.grid.size_y);
+    }
+#pragma omp barrier
+}
+
+// Restricts p and the right-hand side of the grid l to the grid l+1, which
+// then holds the whole problem instead of the error equation.
+template <typename T>
+void Multigrid<T>::restrict_rhs (int l, int tid, int nthreads) {
+    Level& f = levels_[l];
+    Level& c = levels_[l+1];
+    int y_start, y_end;
+    split_rows(c.grid.size_y, tid, nthreads, y_start, y_end);
+    for (int J = y_start; J < y_end; ++J) {
+        int y0 = 2*J, y1 = std::min(2*J + 1, f.grid.size_y - 1);
+        Row_stencil<T> s0 = f.grid.stencil(y0);
+        Row_stencil<T> s1 = f.grid.stencil(y1);
+        for (int I = 0; I < c.grid.size_x; ++I) {
+            int x0 = 2*I, x1 = std::min(2*I + 1, f.grid.size_x - 1);
+            c.rhs(I, J) = 0.25*(rhs_point(s0, f.grid.parameters, x0) + rhs_point(s0, f.grid.parameters, x1)
+                              + rhs_point(s1, f.grid.parameters, x0) + rhs_point(s1, f.grid.parameters, x1));
+            c.p_restricted(I, J) = block_mean(*f.grid.p, I, J, f.grid.size_x, f.grid.size_y);
+        }
+        c.p_restricted.reflect_row_halo(J);
+        copy_row(c.p_restricted, J, c.p, J);
+    }
+#pragma omp barrier
+    reflect_ghost_rows(c.p_restricted, y_start, y_end);
+    reflect_ghost_rows(c.p, y_start, y_end);
+#pragma omp barrier
+}
+
+// Adds the bilinear interpolation of the coarse grid correction of the grid
+// l+1 to p on the grid l.
+template <typename T>
+void Multigrid<T>::correct (int l, int tid, int nthreads) {
+    Level& f = levels_[l];
+    Level& c = levels_[l+1];
+    Field<T>& e = c.p_restricted;
+    int nx = c.grid.size_x;
+    int ny = c.grid.size_y;
+    int y_start, y_end;
+
+    split_rows(ny, tid, nthreads, y_start, y_end);
+    for (int J = y_start; J < y_end; ++J) {
+        T* er = e.row(J);
+        T const* pr = c.p.row(J);
+        for (int I = 0; I < nx; ++I) {
+            er[I] = pr[I] - er[I];
+        }
+        er[-1] = er[0];
+        er[nx] = er[nx-1];
+    }
+    if (y_start == 0 && y_end > 0) {
+        copy_row(e, 0, e, -1);
+    }
+    if (y_end == ny && y_start < y_end) {
+        copy_row(e, ny-1, e, ny);
+    }
+#pragma omp barrier
+    split_rows(f.grid.size_y, tid, nthreads, y_start, y_end);
+    Field<T>& p = *f.grid.p;
+    for (int y = y_start; y < y_end; ++y) {
+        int J = y/2;
+        T const* en  = e.row(J);
+        T const* enn = e.row((y % 2 == 0) ? J-1 : J+1);
+        T* pr = p.row(y);
+        for (int x = 0; x < f.grid.size_x; ++x) {
+            int I = x/2;
+            int X = (x % 2 == 0) ? I-1 : I+1;
+            pr[x] += (9.0*en[I] + 3.0*en[X] + 3.0*enn[I] + enn[X])/16.0;
+        }
+        p.reflect_row_halo(y);
+    }
+#pragma omp barrier
+    reflect_ghost_rows(p, y_start, y_end);
+#pragma omp barrier
+}
+
+template class Multigrid<float>;
+template class Multigrid<double>;
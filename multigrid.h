@@ -0,0 +1,86 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __MULTIGRID_H_INCLUDED__
+#define __MULTIGRID_H_INCLUDED__ 
+
+#include "sweep.h"
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Nonlinear multigrid (full approximation scheme) for the implicit system of
+// one time step. The grids are coarsened by merging 2x2 pixels. The diffusion
+// coefficients gx and gy of a coarse grid are the arithmetic means across and
+// the harmonic means along the direction of the flux of the fine coefficients,
+// gh is the mean over the merged pixels. The smoother is the red-black
+// Gauss-Seidel sweep used by the solver itself.
+//
+// All member functions except setup are called by every thread of the team
+// and synchronize it with barriers.
+///////////////////////////////////////////////////////////////////////////////
+
+struct Multigrid_settings {
+    std::string cycle;    // "V" or "FMG"
+    int pre_smoothing;
+    int post_smoothing;
+    int coarsest_sweeps;
+    int coarsest_size;    // grids are coarsened while both sides are at least twice this
+};
+
+// Instantiated for float and double.
+template <typename T>
+class Multigrid {
+public:
+    typedef typename Sweep_grid<T>::relax_row_fn relax_row_fn;
+
+    // Builds the hierarchy of grids below fine, whose fields are first
+    // touched by a team of nthreads threads. Called by a single thread
+    // whenever the coefficients or the parameters of fine change.
+    void setup (Sweep_grid<T> const& fine, Multigrid_settings const& settings, int nthreads);
+
+    int levels () const { return levels_.size(); }
+
+    // Performs one V-cycle, or a full multigrid cycle if full is true and the
+    // settings ask for it. Returns the largest change in the last sweep over
+    // the rows of the thread on the finest grid.
+    double cycle (relax_row_fn kernel, bool full, int tid, int nthreads);
+
+private:
+    struct Level {
+        Field<T> p, p_restricted, rhs, residual;
+        Field<T> gradp, gh, gx, gy;
+        Sweep_grid<T> grid;
+    };
+
+    double smooth (int l, int nsweeps, relax_row_fn kernel, int tid, int nthreads);
+    double v_cycle (int l, relax_row_fn kernel, int tid, int nthreads);
+    void restrict_residual (int l, int tid, int nthreads);
+    void restrict_rhs (int l, int tid, int nthreads);
+    void correct (int l, int tid, int nthreads);
+    void coarsen_coefficients (int l);
+
+    Multigrid_settings settings_;
+    std::vector<Level> levels_;
+};
+
+#endif /* __MULTIGRID_H_INCLUDED__ */
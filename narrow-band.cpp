@@ -0,0 +1,120 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "narrow-band.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+template <typename T>
+void Narrow_band::setup (Field<T> const& p, int tile_size, double threshold) {
+    tile_size_ = tile_size;
+    threshold_ = threshold;
+    size_x_ = p.size_x();
+    nx_ = (p.size_x() + tile_size - 1)/tile_size;
+    ny_ = (p.size_y() + tile_size - 1)/tile_size;
+    live_.assign(nx_*ny_, 0);
+    active_.assign(nx_*ny_, 0);
+    segments_.assign(ny_, std::vector<Segment>());
+    for (int J = 0; J < ny_; ++J) {
+        for (int I = 0; I < nx_; ++I) {
+            live_[J*nx_ + I] = live(p, static_cast<Field<T> const*>(0), I, J);
+        }
+    }
+    for (int J = 0; J < ny_; ++J) {
+        activate(J);
+    }
+}
+
+template <typename T>
+void Narrow_band::update (Field<T> const& p, Field<T> const& p_old, int tid, int nthreads) {
+    int J_start, J_end;
+    split_rows(ny_, tid, nthreads, J_start, J_end);
+#pragma omp barrier
+    // Inactive tiles have not changed, so only the active ones can be live.
+    for (int J = J_start; J < J_end; ++J) {
+        for (int I = 0; I < nx_; ++I) {
+            int i = J*nx_ + I;
+            live_[i] = active_[i] && live(p, &p_old, I, J);
+        }
+    }
+#pragma omp barrier
+    for (int J = J_start; J < J_end; ++J) {
+        activate(J);
+    }
+#pragma omp barrier
+}
+
+int Narrow_band::active_tiles () const {
+    return std::count(active_.begin(), active_.end(), 1);
+}
+
+template <typename T>
+bool Narrow_band::live (Field<T> const& p, Field<T> const* p_old, int I, int J) const {
+    int x_end = std::min((I + 1)*tile_size_, p.size_x());
+    int y_end = std::min((J + 1)*tile_size_, p.size_y());
+    for (int y = J*tile_size_; y < y_end; ++y) {
+        T const* r = p.row(y);
+        T const* r_old = p_old ? p_old->row(y) : 0;
+        for (int x = I*tile_size_; x < x_end; ++x) {
+            if (r[x] > threshold_ && r[x] < 1.0 - threshold_) {
+                return true;
+            }
+            if (r_old && std::fabs(double(r[x]) - r_old[x]) > threshold_) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Activates the tiles of the row J that are live or have a live neighbour
+// and merges them into segments.
+void Narrow_band::activate (int J) {
+    std::vector<Segment>& segments = segments_[J];
+    segments.clear();
+    for (int I = 0; I < nx_; ++I) {
+        bool active = false;
+        for (int j = std::max(J - 1, 0); j <= std::min(J + 1, ny_ - 1); ++j) {
+            for (int i = std::max(I - 1, 0); i <= std::min(I + 1, nx_ - 1); ++i) {
+                active = active || live_[j*nx_ + i];
+            }
+        }
+        active_[J*nx_ + I] = active;
+        if (!active) {
+            continue;
+        }
+        int x_begin = I*tile_size_;
+        int x_end = std::min(x_begin + tile_size_, size_x_);
+        if (!segments.empty() && segments.back().x_end == x_begin) {
+            segments.back().x_end = x_end;
+        } else {
+            Segment s = {x_begin, x_end};
+            segments.push_back(s);
+        }
+    }
+}
+
+template void Narrow_band::setup (Field<float> const&, int, double);
+template void Narrow_band::setup (Field<double> const&, int, double);
+template void Narrow_band::update (Field<float> const&, Field<float> const&, int, int);
+template void Narrow_band::update (Field<double> const&, Field<double> const&, int, int);
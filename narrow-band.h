@@ -0,0 +1,79 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __NARROW_BAND_H_INCLUDED__
+#define __NARROW_BAND_H_INCLUDED__ 
+
+#include "array.h"
+
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Set of square tiles of the image near the interface. Away from the contour
+// p is 0 or 1 and does not change, so the solver updates only the active
+// tiles. A tile is live if p in it is farther than threshold from both 0 and
+// 1, or if p changed by more than threshold in the last time step; the live
+// tiles and their eight neighbours are active, so the contour can move into
+// a tile before it needs it. Pixels of inactive tiles keep their values.
+///////////////////////////////////////////////////////////////////////////////
+
+class Narrow_band {
+public:
+    // Contiguous pixels x_begin to x_end-1 of a row that are updated.
+    struct Segment {
+        int x_begin, x_end;
+    };
+
+    Narrow_band () : tile_size_(0), nx_(0), ny_(0), threshold_(0.0) { }
+
+    // Splits the image of p into tiles and activates them by the values of
+    // p alone. Called by a single thread.
+    template <typename T>
+    void setup (Field<T> const& p, int tile_size, double threshold);
+
+    // Re-evaluates the active tiles after a time step that started from
+    // p_old. Called by every thread of the team; starts and ends with a
+    // barrier.
+    template <typename T>
+    void update (Field<T> const& p, Field<T> const& p_old, int tid, int nthreads);
+
+    // Active segments of the row y, in increasing order.
+    std::vector<Segment> const& segments (int y) const {
+        return segments_[y/tile_size_];
+    }
+
+    int tiles () const { return nx_*ny_; }
+    int active_tiles () const;
+
+private:
+    template <typename T>
+    bool live (Field<T> const& p, Field<T> const* p_old, int I, int J) const;
+    void activate (int J);
+
+    int tile_size_;
+    int nx_, ny_;
+    int size_x_;
+    double threshold_;
+    std::vector<char> live_, active_;
+    std::vector<std::vector<Segment> > segments_;
+};
+
+#endif /* __NARROW_BAND_H_INCLUDED__ */
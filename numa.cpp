@@ -0,0 +1,132 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "numa.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// The CPUs of the process before any thread was pinned, ordered by node.
+std::vector<int> const& process_cpus () {
+    static std::vector<int> cpus;
+    if (cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        std::vector<std::pair<int, int> > order;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    order.push_back(std::make_pair(cpu_node(cpu), cpu));
+                }
+            }
+        }
+        std::sort(order.begin(), order.end());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            cpus.push_back(order[i].second);
+        }
+        if (cpus.empty()) {
+            cpus.push_back(0);
+        }
+    }
+    return cpus;
+}
+
+}
+
+bool is_placement (std::string const& name) {
+    return name == "none" || name == "close" || name == "spread";
+}
+
+void pin_thread (std::string const& placement, int tid, int nthreads) {
+    if (placement == "none" || nthreads < 2) {
+        return;
+    }
+    std::vector<int> const& cpus = process_cpus();
+    int ncpus = cpus.size();
+    int i = (placement == "spread" && nthreads < ncpus) ? int((long(tid)*ncpus)/nthreads) : tid % ncpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[i], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+void pin_threads (std::string const& placement, int nthreads) {
+    if (placement == "none" || nthreads < 2) {
+        return;
+    }
+    process_cpus();
+#pragma omp parallel default(shared) num_threads(nthreads)
+    {
+#ifdef _OPENMP
+        pin_thread(placement, omp_get_thread_num(), omp_get_num_threads());
+#endif
+    }
+}
+
+Affinity_guard::Affinity_guard () {
+    CPU_ZERO(&set_);
+    saved_ = (sched_getaffinity(0, sizeof(set_), &set_) == 0);
+}
+
+Affinity_guard::~Affinity_guard () {
+    if (saved_) {
+        sched_setaffinity(0, sizeof(set_), &set_);
+    }
+}
+
+int cpu_node (int cpu) {
+    for (int node = 0; node < 1024; ++node) {
+        std::string path = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/node" + to_string(node);
+        if (access(path.c_str(), F_OK) == 0) {
+            return node;
+        }
+        if (access(("/sys/devices/system/node/node" + to_string(node)).c_str(), F_OK) != 0) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// move_pages without target nodes only reports where the pages are.
+std::vector<int> page_nodes (std::vector<void*> const& pages) {
+    std::vector<int> nodes(pages.size(), -1);
+    if (pages.empty()) {
+        return nodes;
+    }
+    std::vector<void*> addresses(pages);
+    if (syscall(SYS_move_pages, 0, addresses.size(), &addresses[0], 0, &nodes[0], 0) != 0) {
+        std::fill(nodes.begin(), nodes.end(), -1);
+        return nodes;
+    }
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        nodes[i] = std::max(nodes[i], -1);
+    }
+    return nodes;
+}
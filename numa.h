@@ -0,0 +1,72 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __NUMA_H_INCLUDED__
+#define __NUMA_H_INCLUDED__ 
+
+#include <boost/noncopyable.hpp>
+
+#include <sched.h>
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Placement of the threads and of the memory on NUMA machines, through the
+// Linux system calls, so that no NUMA library is needed. The CPUs of the
+// process are those it may run on when the first team is pinned, ordered
+// by their node and number.
+///////////////////////////////////////////////////////////////////////////////
+
+// Returns whether name is a placement of the threads: none, close or spread.
+bool is_placement (std::string const& name);
+
+// Pins the calling thread, thread tid of a team of nthreads threads, to one
+// CPU of the process. close gives consecutive threads, which update
+// neighbouring blocks of rows, consecutive CPUs and so fills one node after
+// the other; spread places the threads evenly over all CPUs and nodes. With
+// none, or for a single thread, the thread is left to the system.
+void pin_thread (std::string const& placement, int tid, int nthreads);
+
+// Pins every thread of a team of nthreads threads started by the calling
+// thread, which is thread 0 of the team and so is pinned as well.
+void pin_threads (std::string const& placement, int nthreads);
+
+// Restores the CPUs that the calling thread may run on when it was
+// created, so that a thread that pins its teams is not left on the CPU of
+// its thread 0, nor are the threads that it starts later.
+class Affinity_guard : boost::noncopyable {
+public:
+    Affinity_guard ();
+    ~Affinity_guard ();
+private:
+    cpu_set_t set_;
+    bool saved_;
+};
+
+// Returns the NUMA node of a CPU, 0 on a machine without nodes.
+int cpu_node (int cpu);
+
+// Returns the NUMA node of the page of every address, or -1 where it is not
+// known, e.g., for a page not touched yet or without NUMA in the kernel.
+std::vector<int> page_nodes (std::vector<void*> const& pages);
+
+#endif /* __NUMA_H_INCLUDED__ */
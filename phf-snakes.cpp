@@ -33,228 +33,401 @@
 #include "array.h"
 #include "data.h"
 #include "exceptions.h"
-#include "image_io.h"
+#include "numa.h"
 #include "phf-snakes.h"
+#include "trace.h"
 #include "utils.h"
 
+#include <boost/math/special_functions/fpclassify.hpp>
+
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
+#include <sstream>
 
-int main(int ac, char* av[])
+template <typename T>
+void solve_levels (Phf_snakes_data<T>& shared_data)
 {
-    std::cout << "phf-snakes 1.0 http://github.com/vladimir-ch/phf-snakes/\nCopyright (c) 2008-2012 Vladimir Chalupecky\n";
-
-    Phf_snakes_data shared_data;
-
-    try {
-        shared_data.read_from_file("phf-snakes.dat");
-    }
-    catch (boost::exception & e) {
-        std::cerr << boost::diagnostic_information(e);
-        return EXIT_FAILURE;
-    }
-
+    for (int level = shared_data.pyramid_levels - 1; level >= 0; --level) {
+        if (level != shared_data.level) {
+            shared_data.initialize(level);
+        }
+        shared_data.place_fields();
+        // The threads of the team are pinned while they solve, the calling
+        // thread only until the team ends.
+        Affinity_guard affinity;
 #ifdef _OPENMP
-#pragma omp parallel default(shared)
-    {
-        int tid = omp_get_thread_num();
-        int nthreads = omp_get_num_threads();
-#pragma omp single
+#pragma omp parallel default(shared) num_threads(shared_data.threads)
         {
-            std::cout << "With OpenMP, number of threads = " << nthreads << std::endl;
-            shared_data.print();
-        }
+            int tid = omp_get_thread_num();
+            int nthreads = omp_get_num_threads();
+            pin_thread(shared_data.placement, tid, nthreads);
+#pragma omp single
+            if (shared_data.verbose) {
+                std::cout << "With OpenMP, number of threads = " << nthreads << std::endl;
+                shared_data.print();
+            }
 #else
-    {
-        int tid = 0;
-        int nthreads = 1;
-        std::cout << "Without OpenMP\n";
+        {
+            int tid = 0;
+            int nthreads = 1;
+            if (shared_data.verbose) {
+                std::cout << "Without OpenMP\n";
+            }
 #endif
-        Phf_snakes problem(shared_data, tid, nthreads);
-        problem.solve();
+            Arena::Scope scope(shared_data.arena.get());
+            Phf_snakes<T> problem(shared_data, tid, nthreads);
+            problem.solve();
+        }
+        if (shared_data.verbose) {
+            std::cout << std::endl;
+        }
     }
-    std::cout << std::endl;
 
-    return EXIT_SUCCESS;
+    shared_data.writer.finish();
+    if (shared_data.verbose && shared_data.save_async && shared_data.writer.written() > 0) {
+        std::cout << "snapshots: " << shared_data.writer.written() << " written in the background in "
+                  << std::setprecision(3) << shared_data.writer.write_time() << " s, the solver waited "
+                  << shared_data.writer.wait_time() << " s for a free buffer" << std::endl;
+    }
 }
 
-Phf_snakes::Phf_snakes(Phf_snakes_data& shared_data, int tid, int nthreads)
+template void solve_levels (Phf_snakes_data<float>&);
+template void solve_levels (Phf_snakes_data<double>&);
+
+template <typename T>
+Phf_snakes<T>::Phf_snakes(Phf_snakes_data<T>& shared_data, int tid, int nthreads)
     : shared_data_(shared_data)
     , tid_(tid)
     , nthreads_(nthreads)
 {
     size_x = shared_data_.size_x;
     size_y = shared_data_.size_y;
-    int block_size = size_y / nthreads_;
-    int leftover   = size_y % nthreads_;
-    y_start = tid_ * block_size + std::min(tid_, leftover);
-    y_end = y_start + block_size;
-    if (leftover > tid_) {
-        y_end = y_end + 1;
-    }
+    split_rows(size_y, tid_, nthreads_, y_start, y_end);
     h = shared_data_.h;
     h_pow2_inv = 1.0/(h*h);
-    xi = h;
+    xi = shared_data_.xi;
     a = shared_data_.a;
-    tau = xi*xi/a;
+    tau = shared_data_.tau;
     F = shared_data_.F;
     stationarity_test_constant = shared_data_.C_s*tau;
+    previous_tau = tau;
+    grid_ = shared_data_.grid();
+    Narrow_band::Segment all = {0, size_x};
+    full_row_.assign(1, all);
+    gs_iterations = 0;
+    total_gs_iterations = 0;
+    solver_time = 0.0;
 #pragma omp single
     {
-        shared_data_.conv_diff.resize(nthreads_, 0.0);
         shared_data_.stat_diff.resize(nthreads_, 0.0);
-        shared_data_.step_end = false;
+        shared_data_.residual.resize(nthreads_, 0.0);
+        shared_data_.max_change.resize(nthreads_, 0.0);
         shared_data_.solve_end = false;
     }
 }
 
-void Phf_snakes::solve() {
+template <typename T>
+void Phf_snakes<T>::solve() {
     int nstep = 0;
     do {
-        step();
+        step(false);
+        if (shared_data_.adaptive_tau) {
+            while (!accept_step(nstep + 1)) {
+                restore_step();
+                step(true);
+            }
+        }
         ++nstep;
 
         if (nstep % shared_data_.check_every_n_step == 0) {
-            shared_data_.stat_diff[tid_] = compute_difference();
+            {
+                TRACE_SCOPE("stationarity test");
+                double max_change;
+                shared_data_.stat_diff[tid_] = compute_difference(max_change);
+                shared_data_.residual[tid_] = max_residual(grid_, y_start, y_end);
+            }
+            {
+                TRACE_SCOPE("barrier: stationarity");
 #pragma omp barrier
-#pragma omp single
+            }
+            // The barrier below ends the single.
+#pragma omp single nowait
             {
+                TRACE_SCOPE("single: stationarity reduction");
                 double global_stat_diff = shared_data_.stat_diff[0];
+                double global_residual = shared_data_.residual[0];
                 for (int i = 1; i < nthreads_; ++i) {
                     global_stat_diff += shared_data_.stat_diff[i];
+                    global_residual = std::max(global_residual, shared_data_.residual[i]);
                 }
                 shared_data_.solve_end = global_stat_diff < stationarity_test_constant;
-                std::cout << "Time step: " << std::setw(5) << nstep
-                    // << ", Gauss-Seidel iterations: " << std::setw(6) << gs_iterations
-                          << ", diff = " << std::setw(12) << std::setprecision(5) << global_stat_diff
-                          << ", stop diff = " << std::setw(12) << std::setprecision(5) << stationarity_test_constant
-                          << "\r";
-                std::cout.flush();
+                TRACE_COUNTER("stationarity diff", global_stat_diff);
+                TRACE_COUNTER("residual", global_residual);
+                if (shared_data_.verbose) {
+                    std::cout << "Time step: " << std::setw(5) << nstep
+                              << ", iterations: " << std::setw(5) << gs_iterations
+                              << ", residual = " << std::setw(12) << std::setprecision(5) << global_residual
+                              << band_fill()
+                              << (shared_data_.adaptive_tau ? ", tau = " + to_string(tau*a/(xi*xi)) + "*xi^2/a" : "")
+                              << ", diff = " << std::setw(12) << std::setprecision(5) << global_stat_diff
+                              << ", stop diff = " << std::setw(12) << std::setprecision(5) << stationarity_test_constant
+                              << "\r";
+                    std::cout.flush();
+                }
             }
+            TRACE_SCOPE("barrier: stationarity result");
 #pragma omp barrier
         }
 
         if (nstep % shared_data_.save_every_n_step == 0) {
+            save(nstep, nstep/shared_data_.save_every_n_step);
+        }
+    } while (not shared_data_.solve_end);
+
+    if (nstep % shared_data_.save_every_n_step != 0) {
+        save(nstep, nstep/shared_data_.save_every_n_step + 1);
+    }
 #pragma omp barrier
 #pragma omp single
-            {
-                if (shared_data_.save_images) {
-                    write_png(shared_data_.output_path + "p-" + to_string(nstep/shared_data_.save_every_n_step, 6) + ".png", shared_data_.p);
-                }
-                if (shared_data_.save_gnuplot) {
-                    write_gnuplot(shared_data_.output_path + "p-" + to_string(nstep/shared_data_.save_every_n_step, 6) + ".dat", shared_data_.p);
-                }
+    {
+        std::ostringstream summary;
+        summary << shared_data_.solver->name() << ": " << nstep << " time steps, "
+                << total_gs_iterations << " iterations (" << std::setprecision(3)
+                << double(total_gs_iterations)/nstep << " per step), "
+                << solver_time << " s in the solver";
+        shared_data_.summary = summary.str();
+        if (shared_data_.verbose) {
+            std::cout << "\n" << shared_data_.summary << std::endl;
+            if (shared_data_.adaptive_tau) {
+                std::cout << "adaptive time step: time " << shared_data_.time << " reached, "
+                          << shared_data_.rejected_steps << " steps repeated with a smaller tau" << std::endl;
             }
-#pragma omp barrier
         }
-    } while (not shared_data_.solve_end);
+    }
+}
 
+// Queues a copy of p after nstep steps as the snapshot with the given index
+// for the writer. The threads copy their own rows, so the solver only waits
+// for the copy and, if the writer is behind by all its buffers, for a free
+// buffer.
+template <typename T>
+void Phf_snakes<T>::save(int nstep, int index) {
+    if (!shared_data_.save_images && !shared_data_.save_gnuplot && !shared_data_.frames) {
+        return;
+    }
+    {
+        TRACE_SCOPE("barrier: save");
 #pragma omp barrier
+    }
+    {
+        // The scopes of a single include the barrier that ends it.
+        TRACE_SCOPE("single: acquire snapshot");
 #pragma omp single
+        {
+            shared_data_.snapshot = shared_data_.writer.acquire();
+            shared_data_.snapshot->p.resize(size_x, size_y);
+        }
+    }
     {
-        if (nstep % shared_data_.save_every_n_step != 0) {
-            if (shared_data_.save_images) {
-                write_png(shared_data_.output_path + "p-" + to_string(nstep/shared_data_.save_every_n_step + 1, 6) + ".png", shared_data_.p);
-            }
-            if (shared_data_.save_gnuplot) {
-                write_gnuplot(shared_data_.output_path + "p-" + to_string(nstep/shared_data_.save_every_n_step + 1, 6) + ".dat", shared_data_.p);
-            }
+        TRACE_SCOPE("copy snapshot");
+        Field<T> const& p = shared_data_.p;
+        Field<T>& copy = shared_data_.snapshot->p;
+        for (int y = y_start; y < y_end; ++y) {
+            std::copy(p.row(y), p.row(y) + size_x, copy.row(y));
         }
     }
+    {
+        TRACE_SCOPE("barrier: save");
+#pragma omp barrier
+    }
+    TRACE_SCOPE("single: submit snapshot");
+#pragma omp single
+    {
+        typename Snapshot_writer<T>::Snapshot* snapshot = shared_data_.snapshot;
+        snapshot->name = shared_data_.p_prefix + to_string(index, 6);
+        snapshot->png = shared_data_.save_images;
+        snapshot->gnuplot = shared_data_.save_gnuplot;
+        snapshot->frames = shared_data_.frames;
+        snapshot->step = nstep;
+        snapshot->time = shared_data_.adaptive_tau ? shared_data_.time : nstep*tau;
+        snapshot->tau = tau;
+        shared_data_.writer.submit(snapshot);
+    }
 }
 
-double Phf_snakes::f0 (double s) const {
-    return -a*s*(s - 1)*(s - 0.5);
+// Returns the share of the active tiles for the progress line, or nothing
+// without the narrow band.
+template <typename T>
+std::string Phf_snakes<T>::band_fill () const {
+    if (!grid_.band) {
+        return "";
+    }
+    Narrow_band const& band = *grid_.band;
+    return ", band = " + to_string(100*band.active_tiles()/band.tiles()) + "%";
 }
 
-double Phf_snakes::compute_difference() {
+template <typename T>
+double Phf_snakes<T>::compute_difference(double& max_change) {
     double M = h_pow2_inv/((size_x - 1)*(size_y - 1)); // size of the domain
     double errSum = 0.0;
+    max_change = 0.0;
     for (int y = y_start; y < y_end; ++y) {
-        for (int x = 0; x < size_x; ++x) {
-            errSum += fabs(shared_data_.p[x][y] - shared_data_.p_old[x][y]);
+        T const* p     = shared_data_.p.row(y);
+        T const* p_old = shared_data_.p_old.row(y);
+        std::vector<Narrow_band::Segment> const& row = segments(y);
+        for (std::size_t i = 0; i < row.size(); ++i) {
+            for (int x = row[i].x_begin; x < row[i].x_end; ++x) {
+                double change = fabs(p[x] - p_old[x]);
+                errSum += change;
+                max_change = std::max(max_change, change);
+            }
         }
     }
     return M*errSum;
 }
 
-void Phf_snakes::step() {
-    double pp, up, dp, lp, rp;
-    double ug, dg, lg, rg, gg, gp;
-    double local_diff;
+// Decides whether the step just taken is accepted and which tau the next
+// one uses. tau stays between the fixed step xi^2/a, which is always
+// accepted, and max_tau times that. A step is repeated with half the tau if
+// p changed somewhere by more than max_change or if the solver did not
+// converge; in the latter case tau also never grows back beyond 0.8 times
+// the tau that failed. Otherwise tau grows by a quarter while p changes by
+// less than half of max_change and the solver needs at most
+// target_iterations iterations, and shrinks by a fifth when either gets
+// close to its bound. The accepted steps are logged to tau.dat.
+template <typename T>
+bool Phf_snakes<T>::accept_step(int nstep) {
+    shared_data_.stat_diff[tid_] = compute_difference(shared_data_.max_change[tid_]);
+#pragma omp barrier
+#pragma omp single
+    {
+        double max_change = *std::max_element(shared_data_.max_change.begin(), shared_data_.max_change.end());
+        double diff = 0.0;
+        for (int i = 0; i < nthreads_; ++i) {
+            diff += shared_data_.stat_diff[i];
+        }
+        double tau_min = xi*xi/a;
+        int target = shared_data_.tau_target_iterations;
+        // A diverging solver leaves NaNs, which the maximum of the changes
+        // skips but their sum does not.
+        bool converged = gs_iterations < shared_data_.max_gs_iterations && (boost::math::isfinite)(diff);
+        double error = max_change/shared_data_.tau_max_change;
+        bool reject = (!converged || error > 1.0) && tau > tau_min;
+        double next_tau = tau;
+        if (reject) {
+            next_tau = std::max(tau_min, 0.5*tau);
+            if (!converged) {
+                shared_data_.tau_limit = std::max(tau_min, 0.8*tau);
+            }
+            ++shared_data_.rejected_steps;
+        } else {
+            shared_data_.time += tau;
+            if (shared_data_.tau_log.is_open()) {
+                shared_data_.tau_log << nstep << " " << shared_data_.time << " " << tau << " "
+                                     << gs_iterations << " " << max_change << "\n";
+            }
+            if (error < 0.5 && gs_iterations <= target) {
+                next_tau = std::min(shared_data_.tau_limit, 1.25*tau);
+            } else if (error > 0.8 || gs_iterations > 2*target) {
+                next_tau = std::max(tau_min, 0.8*tau);
+            }
+        }
+        shared_data_.step_rejected = reject;
+        if (next_tau != tau) {
+            shared_data_.tau = next_tau;
+            shared_data_.solver->setup(shared_data_.grid(), nthreads_);
+        }
+    }
+    return !shared_data_.step_rejected;
+}
 
+// Returns p to its state before the last step.
+template <typename T>
+void Phf_snakes<T>::restore_step() {
+    Field<T>& p = shared_data_.p;
     for (int y = y_start; y < y_end; y++) {
-        for (int x = 0; x < size_x; x++) {
-            shared_data_.p_old[x][y] = shared_data_.p[x][y];
+        T const* p_old = shared_data_.p_old.row(y);
+        std::vector<Narrow_band::Segment> const& row = segments(y);
+        for (std::size_t i = 0; i < row.size(); ++i) {
+            std::copy(p_old + row[i].x_begin, p_old + row[i].x_end, p.row(y) + row[i].x_begin);
         }
+        p.reflect_row_halo(y);
     }
 #pragma omp barrier
-    compute_gradient(shared_data_.p, shared_data_.gradpx, shared_data_.gradpy, shared_data_.gradp, h, y_start, y_end);
-    do {
-        local_diff = 0.0;
-#pragma omp barrier
-        for (int y = y_start + y_start % 2; y < y_end; y+=2) {
-            for (int x = 0; x < size_x; x++) {
-                pp = shared_data_.p[x][y];
-                lp = (x == 0)        ? shared_data_.p[1][y]        : shared_data_.p[x-1][y];
-                rp = (x == size_x-1) ? shared_data_.p[size_x-2][y] : shared_data_.p[x+1][y];
-                dp = (y == 0)        ? shared_data_.p[x][1]        : shared_data_.p[x][y-1];
-                up = (y == size_y-1) ? shared_data_.p[x][size_y-2] : shared_data_.p[x][y+1];
-                gp = shared_data_.gradp[x][y];
-
-                gg = shared_data_.gh[x][y];
-                lg = (x == 0)        ? shared_data_.gx[0][y]        : shared_data_.gx[x-1][y];
-                rg = (x == size_x-1) ? shared_data_.gx[size_x-2][y] : shared_data_.gx[x][y];
-                dg = (y == 0)        ? shared_data_.gy[x][0]        : shared_data_.gy[x][y-1];
-                ug = (y == size_y-1) ? shared_data_.gy[x][size_y-2] : shared_data_.gy[x][y];
-
-                double sum = shared_data_.p_old[x][y] + tau * gg * F * gp; // F
-                sum += tau/xi/xi * gg * f0(pp); // tau/xi^2*g*f(p)
-                sum += tau*h_pow2_inv*(lg*lp + dg*dp); // Lp
-                sum += tau*h_pow2_inv*(rg*rp + ug*up); // Up
-                sum /= (1.0 + tau*h_pow2_inv*(rg+lg+ug+dg));
+    p.reflect_halo(y_start, y_start);
+    if (y_end == size_y) {
+        p.reflect_halo(y_end, y_end);
+    }
+}
 
-                local_diff = std::max(local_diff, fabs(pp-sum));
-                shared_data_.p[x][y] = sum;
+template <typename T>
+void Phf_snakes<T>::step(bool repeat) {
+    if (tau != shared_data_.tau) {
+        tau = shared_data_.tau;
+        grid_.parameters.tau = tau;
+        stationarity_test_constant = shared_data_.C_s*tau;
+    }
+    // A repeated step updates the same pixels as the first attempt.
+    if (grid_.band && !repeat) {
+        TRACE_SCOPE("narrow band update");
+        shared_data_.band.update(shared_data_.p, shared_data_.p_old, tid_, nthreads_);
+    }
+    if (grid_.band) {
+        // The pixels outside the band are not updated and have to stay the
+        // same in p, so the band is copied instead.
+        {
+            TRACE_SCOPE("start step");
+            for (int y = y_start; y < y_end; y++) {
+                T const* p = shared_data_.p.row(y);
+                std::vector<Narrow_band::Segment> const& row = segments(y);
+                for (std::size_t i = 0; i < row.size(); ++i) {
+                    std::copy(p + row[i].x_begin, p + row[i].x_end, shared_data_.p_old.row(y) + row[i].x_begin);
+                }
             }
         }
+        {
+            TRACE_SCOPE("barrier: step");
 #pragma omp barrier
-        for (int y = y_start + (y_start + 1) % 2; y < y_end; y+=2) {
-            for (int x = 0; x < size_x; x++) {
-                pp = shared_data_.p[x][y];
-                lp = (x == 0)        ? shared_data_.p[1][y]        : shared_data_.p[x-1][y];
-                rp = (x == size_x-1) ? shared_data_.p[size_x-2][y] : shared_data_.p[x+1][y];
-                dp = (y == 0)        ? shared_data_.p[x][1]        : shared_data_.p[x][y-1];
-                up = (y == size_y-1) ? shared_data_.p[x][size_y-2] : shared_data_.p[x][y+1];
-                gp = shared_data_.gradp[x][y];
-
-                gg = shared_data_.gh[x][y];
-                lg = (x == 0)        ? shared_data_.gx[0][y]        : shared_data_.gx[x-1][y];
-                rg = (x == size_x-1) ? shared_data_.gx[size_x-2][y] : shared_data_.gx[x][y];
-                dg = (y == 0)        ? shared_data_.gy[x][0]        : shared_data_.gy[x][y-1];
-                ug = (y == size_y-1) ? shared_data_.gy[x][size_y-2] : shared_data_.gy[x][y];
-
-                double sum = shared_data_.p_old[x][y] + tau * gg * F * gp; // F
-                sum += tau/xi/xi * gg * f0(pp); // tau/xi^2*g*f(p)
-                sum += tau*h_pow2_inv*(lg*lp + dg*dp); // Lp
-                sum += tau*h_pow2_inv*(rg*rp + ug*up); // Up
-                sum /= (1.0 + tau*h_pow2_inv*(rg+lg+ug+dg));
-
-                local_diff = std::max(local_diff, fabs(pp-sum));
-                shared_data_.p[x][y] = sum;
+        }
+        TRACE_SCOPE("start step");
+        for (int y = y_start; y < y_end; y++) {
+            std::vector<Narrow_band::Segment> const& row = segments(y);
+            for (std::size_t i = 0; i < row.size(); ++i) {
+                compute_gradient_norm(shared_data_.p, shared_data_.gradp, h, y, row[i].x_begin, row[i].x_end);
             }
         }
-        shared_data_.conv_diff[tid_] = local_diff;
+    } else {
+        // p becomes p_old by swapping the buffers. The solver starts from p
+        // extrapolated linearly from the last two steps, which saves about a
+        // third of its iterations; the extrapolation vanishes in the first
+        // step and after restore_step, where p_old equals p.
+        {
+            TRACE_SCOPE("barrier: step");
 #pragma omp barrier
-#pragma omp single
+        }
         {
-            double global_diff = shared_data_.conv_diff[0];
-            for (int i = 1; i < nthreads_; ++i) {
-                global_diff = std::max(global_diff, shared_data_.conv_diff[i]);
-            }
-            shared_data_.step_end = global_diff < shared_data_.gs_conv_tolerance;
+            TRACE_SCOPE("single: swap");
+#pragma omp single
+            shared_data_.p.swap(shared_data_.p_old);
         }
+        TRACE_SCOPE("start step");
+        double w = tau/previous_tau;
+        start_step(shared_data_.p_old, shared_data_.p, shared_data_.gradp, w, h, y_start, y_end);
+    }
+    previous_tau = tau;
+    {
+        TRACE_SCOPE("barrier: step");
 #pragma omp barrier
-    } while (not shared_data_.step_end);
+    }
+    double start = wall_time();
+    gs_iterations = shared_data_.solver->solve(grid_, tid_, nthreads_);
+    solver_time += wall_time() - start;
+    total_gs_iterations += gs_iterations;
+    if (tid_ == 0) {
+        TRACE_COUNTER("gs iterations", gs_iterations);
+    }
 }
 
+template class Phf_snakes<float>;
+template class Phf_snakes<double>;
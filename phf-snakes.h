@@ -22,26 +22,59 @@
 #ifndef __PHF_SNAKES_H_INCLUDED__
 #define __PHF_SNAKES_H_INCLUDED__ 
 
+#include "data.h"
+#include "sweep.h"
+
+#include <string>
+#include <vector>
+
+// One thread of the solver; T is the scalar type of the fields.
+template <typename T>
 class Phf_snakes {
 public:
-    Phf_snakes(Phf_snakes_data& shared_data, int tid, int nthreads);
+    Phf_snakes(Phf_snakes_data<T>& shared_data, int tid, int nthreads);
     void solve();
 
+    // Takes one time step without the tests and the snapshots of solve;
+    // iterations returns the iterations of the solver in the last step.
+    void step(bool repeat);
+    int iterations() const { return gs_iterations; }
+
 private:
-    double f0 (double s) const;
-    double compute_difference();
-    void step();
+    double compute_difference(double& max_change);
+    bool accept_step(int nstep);
+    void restore_step();
+    void save(int nstep, int index);
 
-    Phf_snakes_data& shared_data_;
+    // Pixels of the row y that the time step updates.
+    std::vector<Narrow_band::Segment> const& segments (int y) const {
+        return grid_.band ? grid_.band->segments(y) : full_row_;
+    }
+    std::string band_fill () const;
+
+    Phf_snakes_data<T>& shared_data_;
     int tid_, nthreads_;
     int size_x, size_y;
     int y_start, y_end;
     double h, h_pow2_inv;
     double xi;
     double tau;
+    double previous_tau;        // of the last step
     double a, F;
     double stationarity_test_constant;
     int gs_iterations;
+    long total_gs_iterations;
+    double solver_time;
+    Sweep_grid<T> grid_;
+    std::vector<Narrow_band::Segment> full_row_;
 };
 
+// Solves the segmentation of shared_data, which has been read, level by
+// level from the coarsest one of the pyramid with a team of
+// shared_data.threads threads, and waits until its snapshots are written.
+// The coarsest level may have been initialized already. Throws the errors of
+// initialize and of the writer of the snapshots.
+template <typename T>
+void solve_levels (Phf_snakes_data<T>& shared_data);
+
 #endif /* __PHF_SNAKES_H_INCLUDED__ */
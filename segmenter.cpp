@@ -0,0 +1,81 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "phf-snakes.h"
+#include "segmenter.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <climits>
+
+template <typename T>
+Segmenter<T>::Segmenter (boost::property_tree::ptree const& parameters, int threads) {
+    boost::property_tree::ptree pt(parameters);
+    pt.put("save_images", false);
+    pt.put("save_gnuplot", false);
+    pt.put("save_frames", false);
+    pt.put("save_every_n_step", INT_MAX);
+    data_.threads = threads;
+    data_.verbose = false;
+    data_.configure(pt);
+}
+
+template <typename T>
+Field<T> const& Segmenter<T>::segment (field_t const& image, Field<T> const& initial) {
+    data_.set_images(image, initial);
+    solve_levels(data_);
+    return data_.p;
+}
+
+template <typename T>
+Field<T> const& Segmenter<T>::segment_next (field_t const& image) {
+    data_.set_images(image, data_.p);
+    solve_levels(data_);
+    return data_.p;
+}
+
+template <typename T>
+void Segmenter<T>::segment (unsigned char const* image, unsigned char const* initial, int size_x, int size_y,
+                            std::ptrdiff_t stride, unsigned char* mask, std::ptrdiff_t mask_stride) {
+    image_.resize(size_x, size_y);
+    initial_.resize(size_x, size_y);
+    for (int y = 0; y < size_y; ++y) {
+        unsigned char const* g = image + y*stride;
+        unsigned char const* c = initial + y*stride;
+        double* r = image_.row(y);
+        T* q = initial_.row(y);
+        for (int x = 0; x < size_x; ++x) {
+            r[x] = g[x]/255.0;
+            q[x] = c[x]/255.0;
+        }
+    }
+    Field<T> const& p = segment(image_, initial_);
+    for (int y = 0; y < size_y; ++y) {
+        T const* r = p.row(y);
+        unsigned char* m = mask + y*mask_stride;
+        for (int x = 0; x < size_x; ++x) {
+            m[x] = r[x] >= T(0.5) ? 255 : 0;
+        }
+    }
+}
+
+template class Segmenter<float>;
+template class Segmenter<double>;
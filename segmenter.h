@@ -0,0 +1,76 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __SEGMENTER_H_INCLUDED__
+#define __SEGMENTER_H_INCLUDED__ 
+
+#include "array.h"
+#include "data.h"
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstddef>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+// Segmentation of images in memory, the interface of libphfsnakes. The
+// parameters have the keys of phf-snakes.dat; the image and the keys of the
+// output files are ignored, and nothing is read from or written to files.
+// A segmenter keeps its fields between the calls of segment, so that
+// segmenting a series of images of the same size allocates the fields of
+// the solver only once. Different segmenters may be used concurrently from
+// different threads; each solves with a team of its own of the given number
+// of threads. The errors of the parameters and of the images are thrown as
+// by phf-snakes.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Segmenter {
+public:
+    explicit Segmenter (boost::property_tree::ptree const& parameters, int threads = 1);
+
+    // Segments image, with values in [0,1], from the initial phase field,
+    // 1 inside the initial contour and 0 outside of it, of the same size.
+    // Returns the converged phase field, which is valid until the next call.
+    Field<T> const& segment (field_t const& image, Field<T> const& initial);
+    // Segments the next frame of a sequence, of the size of the last one,
+    // from the phase field of the last call, which converges in a few
+    // steps when the frames differ little.
+    Field<T> const& segment_next (field_t const& image);
+
+    // Segments the 8-bit grey image of size_x by size_y pixels from the
+    // initial contour, which is 255 inside and 0 outside, both stored row by
+    // row with the rows stride bytes apart, and stores the mask, 255 where
+    // the phase field is at least 1/2 and 0 elsewhere, in the rows of
+    // mask_stride bytes of mask.
+    void segment (unsigned char const* image, unsigned char const* initial, int size_x, int size_y,
+                  std::ptrdiff_t stride, unsigned char* mask, std::ptrdiff_t mask_stride);
+
+    // The number of time steps and iterations of the last segmentation.
+    std::string const& summary () const { return data_.summary; }
+
+private:
+    Phf_snakes_data<T> data_;
+    field_t image_;             // the buffers of the last call
+    Field<T> initial_;
+};
+
+#endif /* __SEGMENTER_H_INCLUDED__ */
@@ -0,0 +1,187 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "image_io.h"
+#include "snapshot-writer.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <boost/bind/bind.hpp>
+
+template <typename T>
+Snapshot_writer<T>::Snapshot_writer ()
+    : async_(false)
+    , busy_(0)
+    , stop_(false)
+    , submitted_(0)
+    , appended_(0)
+    , written_(0)
+    , write_time_(0.0)
+    , wait_time_(0.0)
+{ }
+
+template <typename T>
+Snapshot_writer<T>::~Snapshot_writer () {
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stop_ = true;
+    }
+    changed_.notify_all();
+    threads_.join_all();
+}
+
+template <typename T>
+void Snapshot_writer<T>::start (int buffers, bool async, int threads, Png_options const& png_options) {
+    buffers_.resize(buffers);
+    for (int i = 0; i < buffers; ++i) {
+        free_.push_back(&buffers_[i]);
+    }
+    async_ = async;
+    png_options_ = png_options;
+    if (async_) {
+        for (int i = 0; i < threads; ++i) {
+            threads_.create_thread(boost::bind(&Snapshot_writer::run, this));
+        }
+    }
+}
+
+template <typename T>
+typename Snapshot_writer<T>::Snapshot* Snapshot_writer<T>::acquire () {
+    TRACE_SCOPE("wait: snapshot buffer");
+    double start = wall_time();
+    boost::mutex::scoped_lock lock(mutex_);
+    while (free_.empty()) {
+        changed_.wait(lock);
+    }
+    Snapshot* snapshot = free_.front();
+    free_.pop_front();
+    wait_time_ += wall_time() - start;
+    return snapshot;
+}
+
+template <typename T>
+void Snapshot_writer<T>::submit (Snapshot* snapshot) {
+    snapshot->sequence = submitted_++;
+    if (!async_) {
+        write(*snapshot);
+        free_.push_back(snapshot);
+        return;
+    }
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        queue_.push_back(snapshot);
+    }
+    changed_.notify_all();
+}
+
+template <typename T>
+void Snapshot_writer<T>::finish () {
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (!queue_.empty() || busy_ > 0) {
+            changed_.wait(lock);
+        }
+    }
+    if (error_) {
+        boost::exception_ptr error = error_;
+        error_ = boost::exception_ptr();
+        boost::rethrow_exception(error);
+    }
+}
+
+// A writer thread. An error is kept for finish and the following
+// snapshots are still written.
+template <typename T>
+void Snapshot_writer<T>::run () {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (;;) {
+        while (queue_.empty() && !stop_) {
+            changed_.wait(lock);
+        }
+        if (queue_.empty()) {
+            return;
+        }
+        Snapshot* snapshot = queue_.front();
+        queue_.pop_front();
+        ++busy_;
+        lock.unlock();
+        write(*snapshot);
+        lock.lock();
+        --busy_;
+        free_.push_back(snapshot);
+        changed_.notify_all();
+    }
+}
+
+// The images of several snapshots are encoded concurrently by the writer
+// threads, but the frames are appended in the order of the snapshots.
+template <typename T>
+void Snapshot_writer<T>::write (Snapshot& snapshot) {
+    TRACE_SCOPE("write snapshot");
+    double start = wall_time();
+    boost::exception_ptr error;
+    try {
+        if (snapshot.png) {
+            write_png(snapshot.name + ".png", snapshot.p, png_options_);
+        }
+        if (snapshot.gnuplot) {
+            write_gnuplot(snapshot.name + ".dat", snapshot.p);
+        }
+    }
+    catch (...) {
+        error = boost::current_exception();
+    }
+    boost::mutex::scoped_lock lock(mutex_, boost::defer_lock);
+    if (async_) {
+        lock.lock();
+        while (appended_ != snapshot.sequence) {
+            changed_.wait(lock);
+        }
+        lock.unlock();
+    }
+    try {
+        if (snapshot.frames) {
+            snapshot.frames->append(snapshot.p, snapshot.step, snapshot.time, snapshot.tau);
+        }
+    }
+    catch (...) {
+        if (!error) {
+            error = boost::current_exception();
+        }
+    }
+    // The file of frames is closed with the last snapshot of its level.
+    snapshot.frames.reset();
+    if (async_) {
+        lock.lock();
+    }
+    ++appended_;
+    if (error && !error_) {
+        error_ = error;
+    }
+    write_time_ += wall_time() - start;
+    ++written_;
+    if (async_) {
+        changed_.notify_all();
+    }
+}
+
+template class Snapshot_writer<float>;
+template class Snapshot_writer<double>;
@@ -0,0 +1,106 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __SNAPSHOT_WRITER_H_INCLUDED__
+#define __SNAPSHOT_WRITER_H_INCLUDED__ 
+
+#include "array.h"
+#include "frames.h"
+#include "image_io.h"
+
+#include <boost/exception_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes snapshots of p to PNG and gnuplot files and appends them to a file
+// of frames in background threads so that the solver does not wait for the
+// encoding. A snapshot is a copy of p in one of a fixed number of buffers:
+// the solver fills a free buffer and queues it, a writer thread writes it and
+// returns it to the free ones. When all buffers are queued the solver waits
+// for a writer to free one, so the writers can never fall behind by more than
+// that many snapshots. With several writer threads the images of consecutive
+// snapshots are encoded concurrently. Without the background threads the
+// snapshot is written when it is queued.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Snapshot_writer {
+public:
+    struct Snapshot {
+        Field<T> p;
+        std::string name;           // of the files without the extension
+        bool png, gnuplot;
+        boost::shared_ptr<Frame_writer<T> > frames;   // to append p to, if any
+        long step;
+        double time, tau;
+        long sequence;              // of the snapshot in the run
+    };
+
+    Snapshot_writer ();
+    ~Snapshot_writer ();
+
+    // Allocates the buffers and, if async, starts the writer threads; the
+    // images are written with png_options.
+    void start (int buffers, bool async, int threads, Png_options const& png_options);
+
+    // Returns a free buffer, waiting for the writer if there is none.
+    Snapshot* acquire ();
+
+    // Queues a buffer returned by acquire.
+    void submit (Snapshot* snapshot);
+
+    // Waits until all queued snapshots are written and rethrows the first
+    // error of the writer, if any.
+    void finish ();
+
+    // Statistics for the report at the end of a run.
+    int written () const { return written_; }
+    double write_time () const { return write_time_; }
+    double wait_time () const { return wait_time_; }
+
+private:
+    void run ();
+    void write (Snapshot& snapshot);
+
+    std::vector<Snapshot> buffers_;
+    std::deque<Snapshot*> free_, queue_;
+    bool async_;
+    int busy_;                      // writer threads writing a snapshot
+    bool stop_;
+    long submitted_, appended_;     // snapshots queued and done
+    Png_options png_options_;
+    boost::mutex mutex_;
+    boost::condition_variable changed_;
+    boost::thread_group threads_;
+    boost::exception_ptr error_;
+
+    int written_;
+    double write_time_, wait_time_;
+};
+
+#endif /* __SNAPSHOT_WRITER_H_INCLUDED__ */
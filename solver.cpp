@@ -0,0 +1,671 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "exceptions.h"
+#include "solver.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sched.h>
+
+namespace {
+
+// Spectral radius of the Jacobi iteration for the diffusion part of the
+// system, estimated with g = 1.
+double jacobi_spectral_radius (Sweep_parameters const& c) {
+    double d = 4.0*c.tau*c.h_pow2_inv;
+    return d/(1.0 + d);
+}
+
+// Reflects the halo of the rows y_start to y_end-1 of f and, once every
+// thread has done so, the ghost rows next to them.
+template <typename T>
+void reflect_halo (Field<T>& f, int y_start, int y_end) {
+    for (int y = y_start; y < y_end; ++y) {
+        f.reflect_row_halo(y);
+    }
+    {
+        TRACE_SCOPE("barrier: halo");
+#pragma omp barrier
+    }
+    f.reflect_halo(y_start, y_start);
+    if (y_end == f.size_y()) {
+        f.reflect_halo(y_end, y_end);
+    }
+    TRACE_SCOPE("barrier: halo");
+#pragma omp barrier
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Red-black sweeps without team barriers. Each thread counts the half-sweeps
+// it has finished and starts the next one as soon as the threads with the
+// neighbouring blocks of rows have finished the previous one; these are the
+// only rows it reads that other threads write. The convergence test is
+// lagged by one iteration: after iteration k the threads take the maximum of
+// the changes in iteration k-1, which every thread has finished by then
+// unless it is very far behind, so the test rarely waits. All threads stop
+// after the same iteration, one iteration after the changes dropped below
+// the tolerance, and return once their neighbours have finished it too, so
+// that the rows next to their blocks, which e.g. the residual of the
+// stationarity test reads, are final. A single thread has nothing to wait for and tests the
+// current iteration, which reproduces the original solver exactly.
+//
+// With the tasks schedule the rows are split into bands of task_rows rows
+// instead, and every half-sweep of a band is an OpenMP task that depends on
+// the previous half-sweep of the band and its two neighbours. One thread
+// creates the tasks a few iterations ahead and the team runs them as they
+// become ready, so the threads are not tied to fixed rows and the
+// bands near the contour, which converge last, are spread over the whole
+// team. A band skips an iteration if neither it nor its neighbours changed
+// by tolerance or more in the previous one. The iteration in which no band
+// changed by tolerance or more ends the solve; the tasks of later
+// iterations that have not started yet return at once.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Red_black_solver : public Solver<T> {
+public:
+    void setup (Sweep_grid<T> const& grid, int nthreads) {
+        Solver<T>::setup(grid, nthreads);
+        progress_.assign(nthreads, Progress());
+        for (int i = 0; i < history; ++i) {
+            diff_[i].assign(nthreads, 0.0);
+        }
+        band_start_.clear();
+        if (this->settings_.schedule == "tasks") {
+            for (int y = 0; y < grid.size_y; y += this->settings_.task_rows) {
+                band_start_.push_back(y);
+            }
+            band_start_.push_back(grid.size_y);
+            int bands = band_start_.size() - 1;
+            change_.assign(history*bands, 0.0);
+            red_.assign(bands, 0);
+            black_.assign(bands, 0);
+            test_.assign(history, 0);
+        }
+    }
+
+    int solve (Sweep_grid<T> const& grid, int tid, int nthreads) {
+        if (!band_start_.empty()) {
+            return solve_tasks(grid);
+        }
+        Sweep_grid<T> g = grid;
+        int y_start, y_end;
+        split_rows(g.size_y, tid, nthreads, y_start, y_end);
+        int lag = (nthreads > 1) ? 1 : 0;
+        // All threads finished the same number of half-sweeps in the
+        // previous solves.
+        long base = load(progress_[tid].value);
+        int iterations = 0;
+        for (;;) {
+            double local_diff = 0.0;
+            for (int color = 0; color < 2; ++color) {
+                long half_sweep = base + 2*iterations + color;
+                {
+                    TRACE_SCOPE("wait: neighbours");
+                    if (tid > 0) {
+                        wait_for(progress_[tid-1].value, half_sweep);
+                    }
+                    if (tid < nthreads - 1) {
+                        wait_for(progress_[tid+1].value, half_sweep);
+                    }
+                }
+                g.parameters.omega = omega(2*iterations + color);
+                {
+                    TRACE_SCOPE("sweep");
+                    local_diff = std::max(local_diff, relax_rows(g, this->kernel_, color, y_start, y_end));
+                }
+                if (color == 1) {
+                    diff_[iterations % history][tid] = local_diff;
+                }
+                store(progress_[tid].value, half_sweep + 1);
+            }
+            ++iterations;
+            if (iterations >= this->settings_.max_iterations) {
+                break;
+            }
+            if (iterations > lag) {
+                TRACE_SCOPE("wait: convergence test");
+                int k = iterations - 1 - lag;
+                double global_diff = 0.0;
+                for (int i = 0; i < nthreads; ++i) {
+                    wait_for(progress_[i].value, base + 2*k + 2);
+                    global_diff = std::max(global_diff, diff_[k % history][i]);
+                }
+                if (global_diff < this->settings_.tolerance) {
+                    break;
+                }
+            }
+        }
+        {
+            TRACE_SCOPE("wait: neighbours");
+            if (tid > 0) {
+                wait_for(progress_[tid-1].value, base + 2*iterations);
+            }
+            if (tid < nthreads - 1) {
+                wait_for(progress_[tid+1].value, base + 2*iterations);
+            }
+        }
+        return iterations;
+    }
+
+protected:
+    explicit Red_black_solver (Solver_settings const& settings)
+        : Solver<T>(settings), stop_(0), iterations_(0)
+    { }
+
+    // Relaxation factor of the given half-sweep of a time step.
+    virtual double omega (int half_sweep) const = 0;
+
+private:
+    // Slots of the changes; a thread can be at most two iterations ahead of
+    // the slowest one, which may still read the slot of the iteration
+    // before its last.
+    static int const history = 4;
+
+    // Counters on separate cache lines.
+    struct Progress {
+        Progress () : value(0) { }
+        long value;
+        char padding[64 - sizeof(long)];
+    };
+
+    static long load (long const& counter) {
+        long value;
+#pragma omp atomic read seq_cst
+        value = counter;
+        return value;
+    }
+
+    static void store (long& counter, long value) {
+#pragma omp atomic write seq_cst
+        counter = value;
+    }
+
+    // Spins until the counter reaches value, yielding the processor after
+    // a while in case the team has more threads than there are cores.
+    static void wait_for (long const& counter, long value) {
+        for (int spins = 0; load(counter) < value; ++spins) {
+            if (spins > 1000) {
+                sched_yield();
+            }
+        }
+    }
+
+    int solve_tasks (Sweep_grid<T> const& grid) {
+#pragma omp single
+        {
+            int bands = band_start_.size() - 1;
+            int max_iterations = this->settings_.max_iterations;
+            store(stop_, 0);
+            for (int k = 0; k < max_iterations && load(stop_) == 0; ++k) {
+                for (int color = 0; color < 2; ++color) {
+                    std::vector<char>& own = (color == 0) ? red_ : black_;
+                    std::vector<char>& other = (color == 0) ? black_ : red_;
+                    for (int i = 0; i < bands; ++i) {
+                        char* band = &own[i];
+                        char* below = &other[std::max(i-1, 0)];
+                        char* same = &other[i];
+                        char* above = &other[std::min(i+1, bands-1)];
+#pragma omp task default(shared) firstprivate(k, color, i) depend(out: band[0]) depend(in: below[0], same[0], above[0])
+                        relax_band(grid, k, color, i);
+                    }
+                }
+                char* black = &black_[0];
+                char* test = &test_[k % history];
+                long* stop = &stop_;
+#pragma omp task default(shared) firstprivate(k) depend(iterator(j = 0:bands), in: black[j]) depend(out: test[0]) depend(inout: stop[0])
+                test_convergence(k);
+                if (k >= task_lag) {
+                    char* previous_test = &test_[(k - task_lag) % history];
+#pragma omp taskwait depend(in: previous_test[0])
+                }
+            }
+#pragma omp taskwait
+            long stop = load(stop_);
+            iterations_ = (stop > 0) ? stop : max_iterations;
+        }
+        return iterations_;
+    }
+
+    // Updates the rows of the given color in band i in iteration k; the red
+    // half-sweep stores the change of the band, the black one adds its own.
+    void relax_band (Sweep_grid<T> const& grid, int k, int color, int i) {
+        long stop = load(stop_);
+        if (stop > 0 && k >= stop) {
+            return;
+        }
+        int bands = band_start_.size() - 1;
+        double* change = &change_[(k % history)*bands];
+        double const* previous = &change_[((k + history - 1) % history)*bands];
+        bool active = (k == 0);
+        for (int j = std::max(i-1, 0); j <= std::min(i+1, bands-1) && !active; ++j) {
+            active = previous[j] >= this->settings_.tolerance;
+        }
+        double diff = 0.0;
+        if (active) {
+            TRACE_SCOPE("sweep");
+            Sweep_grid<T> g = grid;
+            g.parameters.omega = omega(2*k + color);
+            diff = relax_rows(g, this->kernel_, color, band_start_[i], band_start_[i+1]);
+        }
+        change[i] = (color == 0) ? diff : std::max(change[i], diff);
+    }
+
+    // Stops the solve after iteration k if no band changed by tolerance or
+    // more in it.
+    void test_convergence (int k) {
+        if (load(stop_) > 0) {
+            return;
+        }
+        int bands = band_start_.size() - 1;
+        double const* change = &change_[(k % history)*bands];
+        if (*std::max_element(change, change + bands) < this->settings_.tolerance) {
+            store(stop_, k + 1);
+        }
+    }
+
+    std::vector<Progress> progress_;
+    std::vector<double> diff_[history];
+
+    // The tasks schedule: the first rows of the bands and the size of the
+    // image, the changes of the bands in the last history iterations,
+    // dependence objects of the half-sweeps of the bands and of the
+    // convergence tests, and the iteration after which the solve stops, or
+    // zero. The thread that creates the tasks waits for the test of
+    // iteration k - task_lag before it creates iteration k + 1, so at most
+    // task_lag + 1 iterations are in flight and their changes do not
+    // overwrite those of the iteration the oldest one reads.
+    static int const task_lag = 2;
+    std::vector<int> band_start_;
+    std::vector<double> change_;
+    std::vector<char> red_, black_, test_;
+    long stop_;
+    int iterations_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Red-black Gauss-Seidel, or SOR if omega differs from one.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Sor_solver : public Red_black_solver<T> {
+public:
+    explicit Sor_solver (Solver_settings const& settings)
+        : Red_black_solver<T>(settings), omega_(1.0)
+    { }
+
+    void setup (Sweep_grid<T> const& grid, int nthreads) {
+        Red_black_solver<T>::setup(grid, nthreads);
+        omega_ = 1.0;
+        if (this->name() == "sor") {
+            omega_ = this->settings_.omega;
+            if (omega_ == 0.0) {
+                double rho = jacobi_spectral_radius(grid.parameters);
+                omega_ = 2.0/(1.0 + std::sqrt(1.0 - rho*rho));
+            }
+        }
+    }
+
+    std::string description () const {
+        return this->name() + ", omega = " + to_string(omega_);
+    }
+
+protected:
+    double omega (int) const {
+        return omega_;
+    }
+
+private:
+    double omega_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Red-black SOR with Chebyshev acceleration: the relaxation factor changes
+// after every half-sweep and converges to the optimal one, see Numerical
+// Recipes, section 19.5.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Chebyshev_sor_solver : public Red_black_solver<T> {
+public:
+    explicit Chebyshev_sor_solver (Solver_settings const& settings)
+        : Red_black_solver<T>(settings), rho_(0.0)
+    { }
+
+    void setup (Sweep_grid<T> const& grid, int nthreads) {
+        Red_black_solver<T>::setup(grid, nthreads);
+        rho_ = jacobi_spectral_radius(grid.parameters);
+        omega_.resize(2*this->settings_.max_iterations);
+        omega_[0] = 1.0;
+        if (omega_.size() > 1) {
+            omega_[1] = 1.0/(1.0 - 0.5*rho_*rho_);
+        }
+        for (std::size_t i = 2; i < omega_.size(); ++i) {
+            omega_[i] = 1.0/(1.0 - 0.25*rho_*rho_*omega_[i-1]);
+        }
+    }
+
+    std::string description () const {
+        return this->name() + ", rho(Jacobi) = " + to_string(rho_);
+    }
+
+protected:
+    double omega (int half_sweep) const {
+        return omega_[half_sweep];
+    }
+
+private:
+    double rho_;
+    std::vector<double> omega_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Newton's method with the linear systems solved by the conjugate gradient
+// method preconditioned by the diagonal. The rows of the boundary pixels are
+// scaled by 1/2 (1/4 in the corners), which makes the Neumann discretization
+// symmetric. Where f0 is antidiffusive its derivative is limited so that the
+// linearization stays positive definite; the iteration then converges to
+// the same solution, only more slowly.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Pcg_solver : public Solver<T> {
+public:
+    explicit Pcg_solver (Solver_settings const& settings)
+        : Solver<T>(settings)
+    { }
+
+    void setup (Sweep_grid<T> const& grid, int nthreads) {
+        Solver<T>::setup(grid, nthreads);
+        diagonal_.resize(grid.size_x, grid.size_y, nthreads);
+        r_.resize(grid.size_x, grid.size_y, nthreads);
+        d_.resize(grid.size_x, grid.size_y, nthreads);
+        q_.resize(grid.size_x, grid.size_y, nthreads);
+        delta_.resize(grid.size_x, grid.size_y, nthreads);
+    }
+
+    int solve (Sweep_grid<T> const& grid, int tid, int nthreads) {
+        int y_start, y_end;
+        split_rows(grid.size_y, tid, nthreads, y_start, y_end);
+        int iterations = 0;
+        double change;
+        do {
+            linearize(grid, y_start, y_end);
+            double rz = 0.0, z_max = 0.0;
+            preconditioned_residual(y_start, y_end, rz, z_max);
+            rz = this->team_sum(rz, tid, nthreads);
+            z_max = this->team_max(z_max, tid, nthreads);
+            if (z_max < this->settings_.tolerance) {
+                break;
+            }
+            for (int y = y_start; y < y_end; ++y) {
+                T const* r = r_.row(y);
+                T const* m = diagonal_.row(y);
+                T* d = d_.row(y);
+                T* delta = delta_.row(y);
+                for (int x = 0; x < grid.size_x; ++x) {
+                    d[x] = r[x]/m[x];
+                    delta[x] = 0.0;
+                }
+            }
+            for (;;) {
+                reflect_halo(d_, y_start, y_end);
+                double dq = this->team_sum(apply(grid, y_start, y_end), tid, nthreads);
+                double alpha = rz/dq;
+                for (int y = y_start; y < y_end; ++y) {
+                    T const* d = d_.row(y);
+                    T const* q = q_.row(y);
+                    T* r = r_.row(y);
+                    T* delta = delta_.row(y);
+                    for (int x = 0; x < grid.size_x; ++x) {
+                        delta[x] += alpha*d[x];
+                        r[x] -= alpha*q[x];
+                    }
+                }
+                double rz_new = 0.0;
+                preconditioned_residual(y_start, y_end, rz_new, z_max);
+                rz_new = this->team_sum(rz_new, tid, nthreads);
+                z_max = this->team_max(z_max, tid, nthreads);
+                ++iterations;
+                if (z_max < 0.5*this->settings_.tolerance || iterations >= this->settings_.max_iterations) {
+                    break;
+                }
+                double beta = rz_new/rz;
+                rz = rz_new;
+                for (int y = y_start; y < y_end; ++y) {
+                    T const* r = r_.row(y);
+                    T const* m = diagonal_.row(y);
+                    T* d = d_.row(y);
+                    for (int x = 0; x < grid.size_x; ++x) {
+                        d[x] = r[x]/m[x] + beta*d[x];
+                    }
+                }
+            }
+            double local_change = 0.0;
+            Field<T>& p = *grid.p;
+            for (int y = y_start; y < y_end; ++y) {
+                T const* delta = delta_.row(y);
+                T* pr = p.row(y);
+                for (int x = 0; x < grid.size_x; ++x) {
+                    pr[x] += delta[x];
+                    local_change = std::max(local_change, double(std::fabs(delta[x])));
+                }
+            }
+            reflect_halo(p, y_start, y_end);
+            change = this->team_max(local_change, tid, nthreads);
+        } while (change >= this->settings_.tolerance && iterations < this->settings_.max_iterations);
+        return iterations;
+    }
+
+private:
+    static double weight (int x, int size_x) {
+        return (x == 0 || x == size_x - 1) ? 0.5 : 1.0;
+    }
+
+    // Computes the scaled diagonal of the linearized system and the scaled
+    // residual of the nonlinear one.
+    void linearize (Sweep_grid<T> const& grid, int y_start, int y_end) {
+        Sweep_parameters const& c = grid.parameters;
+        double tau_h = c.tau*c.h_pow2_inv;
+        double tau_xi = c.tau/c.xi/c.xi;
+        for (int y = y_start; y < y_end; ++y) {
+            Row_stencil<T> s = grid.stencil(y);
+            T* m = diagonal_.row(y);
+            T* r = r_.row(y);
+            double wy = weight(y, grid.size_y);
+            for (int x = 0; x < grid.size_x; ++x) {
+                double w = wy*weight(x, grid.size_x);
+                double pp = s.p[x];
+                double df0 = -c.a*(3.0*pp*pp - 3.0*pp + 0.5);
+                double reaction = std::min(tau_xi*s.gh[x]*df0, 0.5);
+                m[x] = w*(1.0 + tau_h*(s.gx[x-1] + s.gx[x] + s.gy_down[x] + s.gy_up[x]) - reaction);
+                r[x] = w*(rhs_point(s, c, x) - operator_point(s, c, x));
+            }
+        }
+    }
+
+    // q = A d in the rows of the thread; returns the local part of (d, q).
+    double apply (Sweep_grid<T> const& grid, int y_start, int y_end) {
+        double tau_h = grid.parameters.tau*grid.parameters.h_pow2_inv;
+        double dq = 0.0;
+        for (int y = y_start; y < y_end; ++y) {
+            T const* d  = d_.row(y);
+            T const* du = d_.row(y+1);
+            T const* dd = d_.row(y-1);
+            T const* m  = diagonal_.row(y);
+            T const* gx = grid.gx->row(y);
+            T const* gu = grid.gy->row(y);
+            T const* gd = grid.gy->row(y-1);
+            T* q = q_.row(y);
+            double wy = weight(y, grid.size_y);
+            for (int x = 0; x < grid.size_x; ++x) {
+                double w = wy*weight(x, grid.size_x);
+                q[x] = m[x]*d[x] - w*tau_h*(gx[x-1]*d[x-1] + gx[x]*d[x+1] + gd[x]*dd[x] + gu[x]*du[x]);
+                dq += d[x]*q[x];
+            }
+        }
+        return dq;
+    }
+
+    void preconditioned_residual (int y_start, int y_end, double& rz, double& z_max) const {
+        rz = 0.0;
+        z_max = 0.0;
+        for (int y = y_start; y < y_end; ++y) {
+            T const* r = r_.row(y);
+            T const* m = diagonal_.row(y);
+            for (int x = 0; x < r_.size_x(); ++x) {
+                double z = r[x]/m[x];
+                rz += r[x]*z;
+                z_max = std::max(z_max, std::fabs(z));
+            }
+        }
+    }
+
+    Field<T> diagonal_, r_, d_, q_, delta_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Multigrid cycles, see multigrid.h.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Multigrid_solver : public Solver<T> {
+public:
+    explicit Multigrid_solver (Solver_settings const& settings)
+        : Solver<T>(settings)
+    { }
+
+    void setup (Sweep_grid<T> const& grid, int nthreads) {
+        Solver<T>::setup(grid, nthreads);
+        multigrid_.setup(grid, this->settings_.multigrid, nthreads);
+    }
+
+    int solve (Sweep_grid<T> const& /*grid*/, int tid, int nthreads) {
+        int iterations = 0;
+        double global_diff;
+        do {
+            double local_diff = multigrid_.cycle(this->kernel_, iterations == 0, tid, nthreads);
+            ++iterations;
+            global_diff = this->team_max(local_diff, tid, nthreads);
+        } while (global_diff >= this->settings_.tolerance && iterations < this->settings_.max_iterations);
+        return iterations;
+    }
+
+    std::string description () const {
+        Multigrid_settings const& s = this->settings_.multigrid;
+        return this->name() + ", " + s.cycle + "(" + to_string(s.pre_smoothing) + "," + to_string(s.post_smoothing)
+            + ") cycle, " + to_string(multigrid_.levels()) + " levels";
+    }
+
+private:
+    Multigrid<T> multigrid_;
+};
+
+}
+
+template <typename T>
+Solver<T>* Solver<T>::create (Solver_settings const& settings) {
+    std::string const& method = settings.method;
+    if (settings.schedule != "static" && settings.schedule != "tasks")
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("unknown schedule " + settings.schedule));
+    if (settings.schedule == "tasks" && (method == "pcg" || method == "multigrid"))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("the tasks schedule needs a red-black solver, not " + method));
+    if (settings.schedule == "tasks" && settings.task_rows < 1)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("task rows " + to_string(settings.task_rows)));
+    if (method == "gauss-seidel" || method == "sor") {
+        return new Sor_solver<T>(settings);
+    }
+    if (method == "chebyshev-sor") {
+        return new Chebyshev_sor_solver<T>(settings);
+    }
+    if (method == "pcg") {
+        return new Pcg_solver<T>(settings);
+    }
+    if (method == "multigrid") {
+        if (settings.multigrid.cycle != "V" && settings.multigrid.cycle != "FMG")
+            BOOST_THROW_EXCEPTION(parameter_error() << string_info("unknown multigrid cycle " + settings.multigrid.cycle));
+        return new Multigrid_solver<T>(settings);
+    }
+    BOOST_THROW_EXCEPTION(parameter_error() << string_info("unknown solver " + method));
+}
+
+template <typename T>
+Solver<T>::Solver (Solver_settings const& settings)
+    : settings_(settings)
+{
+    kernel_ = select_relax_row<T>(settings.simd, kernel_name_);
+}
+
+template <typename T>
+void Solver<T>::setup (Sweep_grid<T> const& /*grid*/, int nthreads) {
+    partial_[0].assign(nthreads, 0.0);
+    partial_[1].assign(nthreads, 0.0);
+    slot_.assign(nthreads, 0);
+}
+
+template <typename T>
+double Solver<T>::team_max (double value, int tid, int nthreads) {
+    return reduce(value, false, tid, nthreads);
+}
+
+template <typename T>
+double Solver<T>::team_sum (double value, int tid, int nthreads) {
+    return reduce(value, true, tid, nthreads);
+}
+
+// The partial results alternate between two buffers, so one barrier per
+// reduction suffices: a thread can write a buffer again only after every
+// thread has passed the barrier of the next reduction, i.e., has read it.
+template <typename T>
+double Solver<T>::reduce (double value, bool sum, int tid, int nthreads) {
+    std::vector<double>& partial = partial_[slot_[tid]];
+    slot_[tid] ^= 1;
+    partial[tid] = value;
+    {
+        TRACE_SCOPE("barrier: reduction");
+#pragma omp barrier
+    }
+    double result = partial[0];
+    for (int i = 1; i < nthreads; ++i) {
+        result = sum ? result + partial[i] : std::max(result, partial[i]);
+    }
+    return result;
+}
+
+template <typename T>
+double max_residual (Sweep_grid<T> const& grid, int y_start, int y_end) {
+    double residual = 0.0;
+    for (int y = y_start; y < y_end; ++y) {
+        Row_stencil<T> s = grid.stencil(y);
+        for (int x = 0; x < grid.size_x; ++x) {
+            residual = std::max(residual, std::fabs(rhs_point(s, grid.parameters, x) - operator_point(s, grid.parameters, x)));
+        }
+    }
+    return residual;
+}
+
+template class Solver<float>;
+template class Solver<double>;
+template double max_residual (Sweep_grid<float> const&, int, int);
+template double max_residual (Sweep_grid<double> const&, int, int);
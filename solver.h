@@ -0,0 +1,102 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __SOLVER_H_INCLUDED__
+#define __SOLVER_H_INCLUDED__ 
+
+#include "multigrid.h"
+#include "sweep.h"
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Solvers of the implicit system of one time step. A solver is created once
+// by Solver::create, prepared by a single thread in setup whenever the grid
+// or the parameters change, and then solve is called by every thread of the
+// team. All of them stop when the largest change of p in an iteration drops
+// below tolerance (the red-black solvers with more than one thread notice it
+// one iteration later, with the tasks schedule some bands of rows may have
+// gone further) or after max_iterations iterations; an iteration is a full
+// red-black sweep, a multigrid cycle or a conjugate gradient step.
+///////////////////////////////////////////////////////////////////////////////
+
+struct Solver_settings {
+    std::string method;   // gauss-seidel, sor, chebyshev-sor, pcg or multigrid
+    double tolerance;
+    int max_iterations;
+    std::string simd;     // instruction set of the row kernel, see select_relax_row
+    double omega;         // for sor, 0 selects the optimal value
+    std::string schedule; // red-black solvers: static blocks of rows, or tasks
+    int task_rows;        // rows of a band with the tasks schedule
+    Multigrid_settings multigrid;
+};
+
+// Instantiated for float and double.
+template <typename T>
+class Solver {
+public:
+    typedef typename Sweep_grid<T>::relax_row_fn relax_row_fn;
+
+    static Solver* create (Solver_settings const& settings);
+
+    virtual ~Solver () { }
+
+    virtual void setup (Sweep_grid<T> const& grid, int nthreads);
+
+    // Solves the system on grid, which has to be the grid passed to setup,
+    // and returns the number of iterations. Each thread updates the rows
+    // that split_rows assigns to it.
+    virtual int solve (Sweep_grid<T> const& grid, int tid, int nthreads) = 0;
+
+    std::string const& name () const { return settings_.method; }
+
+    // The instruction set of the row kernel that was selected.
+    std::string const& kernel_name () const { return kernel_name_; }
+
+    // A short description of the parameters chosen in setup.
+    virtual std::string description () const { return name(); }
+
+protected:
+    explicit Solver (Solver_settings const& settings);
+
+    // Reductions over the team. Each thread passes its own value and gets the
+    // result; all threads have to call them in the same order.
+    double team_max (double value, int tid, int nthreads);
+    double team_sum (double value, int tid, int nthreads);
+
+    Solver_settings settings_;
+    relax_row_fn kernel_;
+
+private:
+    double reduce (double value, bool sum, int tid, int nthreads);
+
+    std::string kernel_name_;
+    std::vector<double> partial_[2];
+    std::vector<int> slot_;
+};
+
+// Returns the largest absolute residual of the implicit system in the rows
+// y_start to y_end-1 of grid.
+template <typename T>
+double max_residual (Sweep_grid<T> const& grid, int y_start, int y_end);
+
+#endif /* __SOLVER_H_INCLUDED__ */
@@ -0,0 +1,132 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __STENCIL_H_INCLUDED__
+#define __STENCIL_H_INCLUDED__ 
+
+#include <cmath>
+
+///////////////////////////////////////////////////////////////////////////////
+// The stencil of the implicit system at a pixel and the row kernels, on plain
+// pointers. This is all that the SIMD translation units include: they are
+// compiled with the -m flags of their instruction set, so any inline function
+// with external linkage that they instantiate, e.g., from boost, could be
+// chosen by the linker for the whole program.
+///////////////////////////////////////////////////////////////////////////////
+
+struct Sweep_parameters {
+    double tau;
+    double xi;
+    double a;
+    double F;
+    double h_pow2_inv;
+    double omega;       // relaxation factor, 1 for Gauss-Seidel
+};
+
+// Rows of the fields that the update of the row p reads. See Phf_snakes_data
+// for the meaning of gx and gy.
+template <typename T>
+struct Row_stencil {
+    T* p;
+    T const* up;
+    T const* down;
+    T const* p_old;
+    T const* gradp;
+    T const* gh;
+    T const* gx;
+    T const* gy_up;
+    T const* gy_down;
+
+    // Updates the pixels x_begin to x_end-1 of a row of size_x pixels and
+    // returns the largest change. If x_end is size_x, the ghost cell
+    // p[size_x] is refreshed before the last pixel is updated; p[x_begin-1]
+    // has to be valid on entry.
+    typedef double (*relax_row_fn) (Row_stencil const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end);
+};
+
+// Kept static so that the copies compiled with different instruction sets
+// in the SIMD translation units do not get merged by the linker. Sor selects
+// over-relaxation by c.omega; it is a template parameter so that the plain
+// Gauss-Seidel update is not changed by rounding. The update is computed in
+// double also for fields of float.
+template <bool Sor, typename T>
+static inline double relax_point (Row_stencil<T> const& s, Sweep_parameters const& c, int x) {
+    double tau = c.tau;
+    double h_pow2_inv = c.h_pow2_inv;
+
+    double pp = s.p[x];
+    double lp = s.p[x-1];
+    double rp = s.p[x+1];
+    double dp = s.down[x];
+    double up = s.up[x];
+    double gp = s.gradp[x];
+
+    double gg = s.gh[x];
+    double lg = s.gx[x-1];
+    double rg = s.gx[x];
+    double dg = s.gy_down[x];
+    double ug = s.gy_up[x];
+
+    double f0 = -c.a*pp*(pp - 1)*(pp - 0.5);
+    double sum = s.p_old[x] + tau * gg * c.F * gp; // F
+    sum += tau/c.xi/c.xi * gg * f0; // tau/xi^2*g*f(p)
+    sum += tau*h_pow2_inv*(lg*lp + dg*dp); // Lp
+    sum += tau*h_pow2_inv*(rg*rp + ug*up); // Up
+    sum /= (1.0 + tau*h_pow2_inv*(rg+lg+ug+dg));
+    if (Sor) {
+        sum = pp + c.omega*(sum - pp);
+    }
+
+    s.p[x] = sum;
+    return std::fabs(pp - s.p[x]);
+}
+
+// Returns the right-hand side of the implicit system at the pixel x, i.e.,
+// the part of the update that does not depend on the unknown p.
+template <typename T>
+static inline double rhs_point (Row_stencil<T> const& s, Sweep_parameters const& c, int x) {
+    return s.p_old[x] + c.tau * s.gh[x] * c.F * s.gradp[x];
+}
+
+// Applies the operator of the implicit system to p at the pixel x. The time
+// step is solved when the operator equals rhs_point at every pixel.
+template <typename T>
+static inline double operator_point (Row_stencil<T> const& s, Sweep_parameters const& c, int x) {
+    double tau_h = c.tau*c.h_pow2_inv;
+    double pp = s.p[x];
+    double lg = s.gx[x-1];
+    double rg = s.gx[x];
+    double dg = s.gy_down[x];
+    double ug = s.gy_up[x];
+    double f0 = -c.a*pp*(pp - 1)*(pp - 0.5);
+    return (1.0 + tau_h*(rg+lg+ug+dg))*pp
+        - tau_h*(lg*s.p[x-1] + dg*s.down[x] + rg*s.p[x+1] + ug*s.up[x])
+        - c.tau/c.xi/c.xi * s.gh[x] * f0;
+}
+
+// Row kernels, instantiated for float and double. The SIMD kernels for float
+// compute in float and update twice as many pixels per instruction.
+template <typename T> double relax_row_scalar (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end);
+template <typename T> double relax_row_sse2   (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end);
+template <typename T> double relax_row_avx2   (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end);
+template <typename T> double relax_row_avx512 (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end);
+
+#endif /* __STENCIL_H_INCLUDED__ */
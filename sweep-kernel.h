@@ -0,0 +1,189 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __SWEEP_KERNEL_H_INCLUDED__
+#define __SWEEP_KERNEL_H_INCLUDED__ 
+
+#include "stencil.h"
+
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////////
+// Generic SIMD row kernel written with the GCC vector extensions. It is
+// included by one translation unit per instruction set, each compiled with
+// the corresponding -m flags, and instantiated with the scalar type of the
+// fields and the number of them that fit into a register of that instruction
+// set. Nothing here, nor in the headers it includes, may be an inline
+// function with external linkage (std::max included), since the linker could
+// pick the copy built for a wider instruction set.
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Integer type of the size of T, for the shuffle masks.
+template <typename T> struct Lane_index;
+template <> struct Lane_index<float>  { typedef int type; };
+template <> struct Lane_index<double> { typedef long long type; };
+
+template <typename T, int W>
+struct Simd {
+    typedef T vec __attribute__((vector_size(W*sizeof(T))));
+    typedef typename Lane_index<T>::type mask __attribute__((vector_size(W*sizeof(T))));
+
+    static vec load (T const* ptr) {
+        vec v;
+        std::memcpy(&v, ptr, sizeof(v));
+        return v;
+    }
+
+    static void store (T* ptr, vec v) {
+        std::memcpy(ptr, &v, sizeof(v));
+    }
+
+    // Returns {prev[W-1], next[0], ..., next[W-2]}.
+    static vec shift_in (vec prev, vec next);
+};
+
+template <>
+inline Simd<double, 2>::vec Simd<double, 2>::shift_in (vec prev, vec next) {
+    mask m = {1, 2};
+    return __builtin_shuffle(prev, next, m);
+}
+
+template <>
+inline Simd<float, 4>::vec Simd<float, 4>::shift_in (vec prev, vec next) {
+    mask m = {3, 4, 5, 6};
+    return __builtin_shuffle(prev, next, m);
+}
+
+#ifdef __AVX__
+template <>
+inline Simd<double, 4>::vec Simd<double, 4>::shift_in (vec prev, vec next) {
+    mask m = {3, 4, 5, 6};
+    return __builtin_shuffle(prev, next, m);
+}
+
+template <>
+inline Simd<float, 8>::vec Simd<float, 8>::shift_in (vec prev, vec next) {
+    mask m = {7, 8, 9, 10, 11, 12, 13, 14};
+    return __builtin_shuffle(prev, next, m);
+}
+#endif
+
+#ifdef __AVX512F__
+template <>
+inline Simd<double, 8>::vec Simd<double, 8>::shift_in (vec prev, vec next) {
+    mask m = {7, 8, 9, 10, 11, 12, 13, 14};
+    return __builtin_shuffle(prev, next, m);
+}
+
+template <>
+inline Simd<float, 16>::vec Simd<float, 16>::shift_in (vec prev, vec next) {
+    mask m = {15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30};
+    return __builtin_shuffle(prev, next, m);
+}
+#endif
+
+template <typename T, int W, bool Sor>
+double relax_row_simd (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end) {
+    typedef Simd<T, W> S;
+    typedef typename S::vec vec;
+
+    T const tau_F      = c.tau*c.F;
+    T const tau_xi_inv = c.tau/c.xi/c.xi;
+    T const tau_h_inv  = c.tau*c.h_pow2_inv;
+    T const a          = c.a;
+    T const omega      = c.omega;
+    T const one        = 1.0;
+    T const half       = 0.5;
+
+    T* p = s.p;
+    double local_diff = 0.0;
+    double d;
+
+    int x = x_begin;
+    if (x == 0) {
+        local_diff = relax_point<Sor>(s, c, 0);
+        x = 1;
+    }
+    int x_stop = (x_end < size_x - 1) ? x_end : size_x - 1;
+
+    // The left neighbours of a chunk are assembled from the previous chunk
+    // kept in a register, loading them from memory right after the store
+    // would stall on store forwarding.
+    vec prev = S::load(p + x - W);
+    vec diff = vec() + T(0);
+    for (; x + W <= x_stop; x += W) {
+        vec pp = S::load(p + x);
+        vec lp = S::shift_in(prev, pp);
+        vec rp = S::load(p + x + 1);
+        vec dp = S::load(s.down + x);
+        vec up = S::load(s.up + x);
+
+        vec gg = S::load(s.gh + x);
+        vec lg = S::load(s.gx + x - 1);
+        vec rg = S::load(s.gx + x);
+        vec dg = S::load(s.gy_down + x);
+        vec ug = S::load(s.gy_up + x);
+
+        vec f0 = -a*pp*(pp - one)*(pp - half);
+        vec sum = S::load(s.p_old + x) + tau_F*gg*S::load(s.gradp + x);
+        sum += tau_xi_inv*gg*f0;
+        sum += tau_h_inv*(lg*lp + dg*dp);
+        sum += tau_h_inv*(rg*rp + ug*up);
+        sum /= one + tau_h_inv*(rg + lg + ug + dg);
+        if (Sor) {
+            sum = pp + omega*(sum - pp);
+        }
+
+        vec dv = pp - sum;
+        dv = (dv < T(0)) ? -dv : dv;
+        diff = (dv > diff) ? dv : diff;
+        S::store(p + x, sum);
+        prev = sum;
+    }
+    for (int i = 0; i < W; ++i) {
+        if (diff[i] > local_diff) local_diff = diff[i];
+    }
+
+    for (; x < x_stop; ++x) {
+        d = relax_point<Sor>(s, c, x);
+        if (d > local_diff) local_diff = d;
+    }
+    if (x_end == size_x) {
+        p[size_x] = p[size_x-2];
+        d = relax_point<Sor>(s, c, size_x-1);
+        if (d > local_diff) local_diff = d;
+    }
+    return local_diff;
+}
+
+template <typename T, int W>
+double relax_row_simd (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end) {
+    if (c.omega == 1.0) {
+        return relax_row_simd<T, W, false>(s, c, size_x, x_begin, x_end);
+    }
+    return relax_row_simd<T, W, true>(s, c, size_x, x_begin, x_end);
+}
+
+}
+
+#endif /* __SWEEP_KERNEL_H_INCLUDED__ */
@@ -0,0 +1,152 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "exceptions.h"
+#include "sweep.h"
+
+#include <algorithm>
+
+namespace {
+
+template <bool Sor, typename T>
+double relax_row_scalar (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end) {
+    double local_diff = 0.0;
+    for (int x = x_begin; x < std::min(x_end, size_x-1); x++) {
+        local_diff = std::max(local_diff, relax_point<Sor>(s, c, x));
+    }
+    if (x_end == size_x) {
+        s.p[size_x] = s.p[size_x-2];
+        local_diff = std::max(local_diff, relax_point<Sor>(s, c, size_x-1));
+    }
+    return local_diff;
+}
+
+#ifdef HAVE_X86_SIMD
+// Returns whether the CPU has the instructions of the kernel of isa.
+bool cpu_supports (std::string const& isa) {
+    __builtin_cpu_init();
+    if (isa == "avx512") {
+        return __builtin_cpu_supports("avx512f");
+    }
+    if (isa == "avx2") {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    if (isa == "sse2") {
+        return __builtin_cpu_supports("sse2");
+    }
+    return true;
+}
+#endif
+
+}
+
+template <typename T>
+double relax_row_scalar (Row_stencil<T> const& s, Sweep_parameters const& c, int size_x, int x_begin, int x_end) {
+    if (c.omega == 1.0) {
+        return relax_row_scalar<false>(s, c, size_x, x_begin, x_end);
+    }
+    return relax_row_scalar<true>(s, c, size_x, x_begin, x_end);
+}
+
+template <typename T>
+double relax_row (Sweep_grid<T> const& grid, typename Sweep_grid<T>::relax_row_fn kernel, int y) {
+    Field<T>& p = *grid.p;
+    int size_x = grid.size_x;
+    Row_stencil<T> s = grid.stencil(y);
+    double local_diff = 0.0;
+    if (grid.band) {
+        std::vector<Narrow_band::Segment> const& segments = grid.band->segments(y);
+        for (std::size_t i = 0; i < segments.size(); ++i) {
+            local_diff = std::max(local_diff, kernel(s, grid.parameters, size_x, segments[i].x_begin, segments[i].x_end));
+        }
+    } else {
+        local_diff = kernel(s, grid.parameters, size_x, 0, size_x);
+    }
+    p.reflect_row_halo(y);
+
+    T* r = p.row(y);
+    if (y == 1) {
+        std::copy(r - 1, r + size_x + 1, p.row(-1) - 1);
+    }
+    if (y == grid.size_y-2) {
+        std::copy(r - 1, r + size_x + 1, p.row(grid.size_y) - 1);
+    }
+    return local_diff;
+}
+
+template <typename T>
+double relax_rows (Sweep_grid<T> const& grid, typename Sweep_grid<T>::relax_row_fn kernel, int color, int y_start, int y_end) {
+    double local_diff = 0.0;
+    for (int y = y_start + (y_start + color) % 2; y < y_end; y+=2) {
+        local_diff = std::max(local_diff, relax_row(grid, kernel, y));
+    }
+    return local_diff;
+}
+
+template <typename T>
+typename Row_stencil<T>::relax_row_fn select_relax_row (std::string const& name, std::string& selected) {
+    std::string isa = name;
+#ifdef HAVE_X86_SIMD
+    if (isa == "auto") {
+        if (cpu_supports("avx512")) {
+            isa = "avx512";
+        } else if (cpu_supports("avx2")) {
+            isa = "avx2";
+        } else if (cpu_supports("sse2")) {
+            isa = "sse2";
+        } else {
+            isa = "scalar";
+        }
+    }
+    if ((isa == "sse2" || isa == "avx2" || isa == "avx512") && !cpu_supports(isa))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("SIMD instruction set " + isa + " not supported by this CPU"));
+    if (isa == "sse2") {
+        selected = isa;
+        return relax_row_sse2<T>;
+    }
+    if (isa == "avx2") {
+        selected = isa;
+        return relax_row_avx2<T>;
+    }
+    if (isa == "avx512") {
+        selected = isa;
+        return relax_row_avx512<T>;
+    }
+#else
+    if (isa == "auto") {
+        isa = "scalar";
+    }
+#endif
+    if (isa == "scalar") {
+        selected = isa;
+        return relax_row_scalar<T>;
+    }
+    BOOST_THROW_EXCEPTION(parameter_error() << string_info("unknown SIMD instruction set " + name));
+}
+
+template double relax_row_scalar (Row_stencil<float> const&, Sweep_parameters const&, int, int, int);
+template double relax_row_scalar (Row_stencil<double> const&, Sweep_parameters const&, int, int, int);
+template double relax_row (Sweep_grid<float> const&, Sweep_grid<float>::relax_row_fn, int);
+template double relax_row (Sweep_grid<double> const&, Sweep_grid<double>::relax_row_fn, int);
+template double relax_rows (Sweep_grid<float> const&, Sweep_grid<float>::relax_row_fn, int, int, int);
+template double relax_rows (Sweep_grid<double> const&, Sweep_grid<double>::relax_row_fn, int, int, int);
+template Row_stencil<float>::relax_row_fn select_relax_row<float> (std::string const&, std::string&);
+template Row_stencil<double>::relax_row_fn select_relax_row<double> (std::string const&, std::string&);
@@ -0,0 +1,100 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __SWEEP_H_INCLUDED__
+#define __SWEEP_H_INCLUDED__ 
+
+#include "array.h"
+#include "narrow-band.h"
+#include "stencil.h"
+
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels that update one row of the phase field by the Gauss-Seidel method.
+// The scalar kernel visits the pixels from left to right and reproduces the
+// original solver exactly. The SIMD kernels update the interior of the row in
+// chunks of as many pixels as fit into a vector register: within a chunk the
+// left and right neighbours are the values from the previous iteration
+// (Jacobi), between chunks they are the already updated ones (Gauss-Seidel).
+// The boundary pixels x = 0 and x = size_x-1 and the remainder of the row are
+// always updated by the scalar code.
+//
+// All kernels iterate to the solution of the same nonlinear system, so the
+// solution of a time step differs between them only by the error allowed by
+// gs_conv_tolerance. On the bundled images the stationary fields computed by
+// the scalar and the SIMD kernels differ by at most 2*gs_conv_tolerance and
+// need the same number of time steps.
+///////////////////////////////////////////////////////////////////////////////
+
+// Returns the kernel for the instruction set given by name ("scalar", "sse2",
+// "avx2" or "avx512"). For "auto" the widest instruction set supported by the
+// processor is chosen. The name of the selected kernel is stored in selected.
+template <typename T>
+typename Row_stencil<T>::relax_row_fn select_relax_row (std::string const& name, std::string& selected);
+
+// Fields and parameters of the implicit system of one time step on a grid.
+// On the grid of the image these are the fields of Phf_snakes_data. The
+// coarse grids of the multigrid solver store their right-hand side in p_old
+// and have F = 0.
+template <typename T>
+struct Sweep_grid {
+    typedef typename Row_stencil<T>::relax_row_fn relax_row_fn;
+
+    int size_x, size_y;
+    Field<T>* p;
+    Field<T> const* p_old;
+    Field<T> const* gradp;
+    Field<T> const* gh;
+    Field<T> const* gx;
+    Field<T> const* gy;
+    Narrow_band const* band;    // the pixels to update, all if null
+    Sweep_parameters parameters;
+
+    Row_stencil<T> stencil (int y) const {
+        Row_stencil<T> s;
+        s.p       = p->row(y);
+        s.up      = p->row(y+1);
+        s.down    = p->row(y-1);
+        s.p_old   = p_old->row(y);
+        s.gradp   = gradp->row(y);
+        s.gh      = gh->row(y);
+        s.gx      = gx->row(y);
+        s.gy_up   = gy->row(y);
+        s.gy_down = gy->row(y-1);
+        return s;
+    }
+};
+
+// Updates the row y of the grid, or its active segments if the grid has a
+// narrow band, by the kernel and returns the largest change. The halo of p is
+// refreshed for the row afterwards, the ghost rows by whoever updates the
+// rows next to them.
+template <typename T>
+double relax_row (Sweep_grid<T> const& grid, typename Sweep_grid<T>::relax_row_fn kernel, int y);
+
+// Updates the rows y_start + parity, y_start + parity + 2, ... below y_end,
+// where parity is chosen so that the updated rows have the given color, and
+// returns the largest change.
+template <typename T>
+double relax_rows (Sweep_grid<T> const& grid, typename Sweep_grid<T>::relax_row_fn kernel, int color, int y_start, int y_end);
+
+#endif /* __SWEEP_H_INCLUDED__ */
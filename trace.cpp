@@ -0,0 +1,209 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "trace.h"
+
+#ifdef PHF_TRACE
+
+#include "exceptions.h"
+#include "utils.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+struct Trace_event {
+    char const* name;
+    double start;           // in us
+    double duration;        // of an interval, or -1 for a counter
+    double value;           // of a counter
+};
+
+struct Trace_buffer {
+    int id;
+    std::vector<Trace_event> events;
+};
+
+// The buffers of all threads that recorded something, in the order of
+// their first event. A buffer outlives its thread.
+boost::mutex registry_mutex;
+std::vector<Trace_buffer*> registry;
+
+__thread Trace_buffer* current = 0;
+
+Trace_buffer& buffer () {
+    if (!current) {
+        current = new Trace_buffer;
+        current->events.reserve(1 << 16);
+        boost::mutex::scoped_lock lock(registry_mutex);
+        current->id = registry.size();
+        registry.push_back(current);
+    }
+    return *current;
+}
+
+struct Interval_total {
+    Interval_total () : calls(0), time(0.0) { }
+    long calls;
+    double time;
+};
+
+struct Counter_total {
+    Counter_total () : count(0), sum(0.0), min(0.0), max(0.0) { }
+    long count;
+    double sum, min, max;
+};
+
+}
+
+double trace_now () {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return 1.0e6*t.tv_sec + 1.0e-3*t.tv_nsec;
+}
+
+void trace_interval (char const* name, double start, double end) {
+    Trace_event e = {name, start, end - start, 0.0};
+    buffer().events.push_back(e);
+}
+
+void trace_counter (char const* name, double value) {
+    Trace_event e = {name, trace_now(), -1.0, value};
+    buffer().events.push_back(e);
+}
+
+void trace_clear () {
+    boost::mutex::scoped_lock lock(registry_mutex);
+    for (std::size_t i = 0; i < registry.size(); ++i) {
+        registry[i]->events.clear();
+    }
+}
+
+// The times are written in us from the first event, as the format expects.
+void trace_write (std::string const& filename) {
+    std::ofstream out(filename.c_str());
+    if (!out)
+        BOOST_THROW_EXCEPTION(file_open_error() << string_info(filename));
+    boost::mutex::scoped_lock lock(registry_mutex);
+    double origin = -1.0;
+    for (std::size_t i = 0; i < registry.size(); ++i) {
+        if (!registry[i]->events.empty() && (origin < 0.0 || registry[i]->events[0].start < origin)) {
+            origin = registry[i]->events[0].start;
+        }
+    }
+    out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"phf-snakes\"}}";
+    for (std::size_t i = 0; i < registry.size(); ++i) {
+        Trace_buffer const& b = *registry[i];
+        out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << b.id
+            << ", \"args\": {\"name\": \"thread " << b.id << "\"}}";
+        for (std::size_t j = 0; j < b.events.size(); ++j) {
+            Trace_event const& e = b.events[j];
+            out << ",\n{\"name\": \"" << e.name << "\", \"pid\": 1, \"tid\": " << b.id << ", \"ts\": " << e.start - origin;
+            if (e.duration >= 0.0) {
+                out << ", \"ph\": \"X\", \"dur\": " << e.duration << "}";
+            } else {
+                out << ", \"ph\": \"C\", \"args\": {\"value\": " << std::setprecision(9) << e.value << std::setprecision(3) << "}}";
+            }
+        }
+    }
+    out << "\n]}\n";
+}
+
+void trace_summary (std::ostream& out) {
+    boost::mutex::scoped_lock lock(registry_mutex);
+    std::size_t threads = registry.size();
+    std::map<std::string, std::vector<Interval_total> > intervals;
+    std::map<std::string, std::vector<Counter_total> > counters;
+    std::vector<double> span(threads, 0.0);
+    for (std::size_t i = 0; i < threads; ++i) {
+        std::vector<Trace_event> const& events = registry[i]->events;
+        double first = 0.0, last = 0.0;
+        for (std::size_t j = 0; j < events.size(); ++j) {
+            Trace_event const& e = events[j];
+            if (j == 0 || e.start < first) {
+                first = e.start;
+            }
+            last = std::max(last, e.start + std::max(e.duration, 0.0));
+            if (e.duration >= 0.0) {
+                std::vector<Interval_total>& t = intervals[e.name];
+                t.resize(threads);
+                ++t[i].calls;
+                t[i].time += e.duration;
+            } else {
+                std::vector<Counter_total>& c = counters[e.name];
+                c.resize(threads);
+                Counter_total& s = c[i];
+                s.min = (s.count == 0) ? e.value : std::min(s.min, e.value);
+                s.max = (s.count == 0) ? e.value : std::max(s.max, e.value);
+                s.sum += e.value;
+                ++s.count;
+            }
+        }
+        span[i] = last - first;
+    }
+
+    out << std::fixed << std::setprecision(1);
+    out << "trace: time in ms per thread, from the first to the last event and in the intervals\n";
+    out << std::setw(32) << std::left << "" << std::right;
+    for (std::size_t i = 0; i < threads; ++i) {
+        out << std::setw(12) << ("thread " + to_string(i));
+    }
+    out << "\n" << std::setw(32) << std::left << "span" << std::right;
+    for (std::size_t i = 0; i < threads; ++i) {
+        out << std::setw(12) << 1.0e-3*span[i];
+    }
+    out << "\n";
+    for (std::map<std::string, std::vector<Interval_total> >::const_iterator it = intervals.begin(); it != intervals.end(); ++it) {
+        out << std::setw(32) << std::left << it->first << std::right;
+        for (std::size_t i = 0; i < threads; ++i) {
+            out << std::setw(12) << 1.0e-3*it->second[i].time;
+        }
+        out << "\n";
+    }
+    if (!counters.empty()) {
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6) << "trace: counters, count mean min max\n";
+    }
+    for (std::map<std::string, std::vector<Counter_total> >::const_iterator it = counters.begin(); it != counters.end(); ++it) {
+        for (std::size_t i = 0; i < threads; ++i) {
+            Counter_total const& c = it->second[i];
+            if (c.count == 0) {
+                continue;
+            }
+            out << std::setw(32) << std::left << it->first << std::right << " thread " << std::setw(3) << i
+                << std::setw(10) << c.count << std::setw(14) << c.sum/c.count
+                << std::setw(14) << c.min << std::setw(14) << c.max << "\n";
+        }
+    }
+    out.unsetf(std::ios::floatfield);
+    out.flush();
+}
+
+#endif
@@ -0,0 +1,79 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __TRACE_H_INCLUDED__
+#define __TRACE_H_INCLUDED__ 
+
+///////////////////////////////////////////////////////////////////////////////
+// Timeline of the threads of the solver, compiled in only with PHF_TRACE
+// defined (cmake -DPHF_TRACE=ON); otherwise the macros expand to nothing.
+// TRACE_SCOPE times the enclosing block as an interval with the given name
+// and TRACE_COUNTER records a value, both in a buffer of the calling thread
+// that no other thread touches, so that recording costs two reads of the
+// clock and no synchronization. The names have to be string literals.
+//
+// trace_write exports the buffers of all threads in the JSON trace format
+// read by chrome://tracing and Perfetto; trace_summary prints the total time
+// of every interval and the statistics of every counter per thread.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef PHF_TRACE
+
+#include <iosfwd>
+#include <string>
+
+// Microseconds from an arbitrary fixed point in the past.
+double trace_now ();
+void trace_interval (char const* name, double start, double end);
+void trace_counter (char const* name, double value);
+void trace_write (std::string const& filename);
+void trace_summary (std::ostream& out);
+// Discards everything recorded so far.
+void trace_clear ();
+
+class Trace_scope {
+public:
+    explicit Trace_scope (char const* name)
+        : name_(name), start_(trace_now())
+    { }
+
+    ~Trace_scope () {
+        trace_interval(name_, start_, trace_now());
+    }
+
+private:
+    char const* name_;
+    double start_;
+};
+
+#define TRACE_CONCAT_(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) trace_counter(name, value)
+
+#else
+
+#define TRACE_SCOPE(name) do { } while (0)
+#define TRACE_COUNTER(name, value) do { } while (0)
+
+#endif
+
+#endif /* __TRACE_H_INCLUDED__ */
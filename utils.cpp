@@ -21,8 +21,10 @@
 
 #include "utils.h"
 
+#include <algorithm>
 #include <ctime>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 std::string jobid () {
@@ -37,12 +39,18 @@ std::string jobid () {
     return id;
 }
 
-std::string prepare_output_directory (std::string const& problem_name) {
+double wall_time () {
+    timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + 1.0e-6*t.tv_usec;
+}
+
+std::string prepare_output_directory (std::string const& problem_name, std::string const& tag) {
     std::string path = "./results/";
     mkdir(path.c_str(), 0700);
     path += problem_name + "/";
     mkdir(path.c_str(), 0700);
-    path += jobid() + "/";
+    path += jobid() + tag + "/";
     mkdir(path.c_str(), 0700);
     return path;
 }
@@ -22,6 +22,7 @@
 #ifndef __UTILS_H_INCLUDED__
 #define __UTILS_H_INCLUDED__ 
 
+#include <algorithm>
 #include <iomanip>
 #include <string>
 #include <sstream>
@@ -40,6 +41,23 @@ std::string to_string (const T& t, int ndigits = 0) {
 
 std::string jobid ();
 
-std::string prepare_output_directory (std::string const& problem_name);
+// Splits the rows 0 to size_y-1 into nthreads contiguous blocks that differ
+// in size by at most one row and returns the block of the thread tid.
+inline void split_rows (int size_y, int tid, int nthreads, int& y_start, int& y_end) {
+    int block_size = size_y / nthreads;
+    int leftover   = size_y % nthreads;
+    y_start = tid * block_size + std::min(tid, leftover);
+    y_end = y_start + block_size;
+    if (leftover > tid) {
+        y_end = y_end + 1;
+    }
+}
+
+// Returns the time in seconds from an arbitrary fixed point in the past.
+double wall_time ();
+
+// Creates ./results/<problem_name>/<jobid><tag>/ and returns its path. The
+// tag tells apart the jobs of a batch that start in the same second.
+std::string prepare_output_directory (std::string const& problem_name, std::string const& tag = "");
 
 #endif /* __UTILS_H_INCLUDED__ */
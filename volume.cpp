@@ -0,0 +1,463 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "exceptions.h"
+#include "image_io.h"
+#include "utils.h"
+#include "volume.h"
+
+#include <boost/format.hpp>
+#include <boost/property_tree/info_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Reflects z into [0, size) as the halo of a field does, i.e., the slice -i
+// stands for the slice i.
+int reflect (int z, int size) {
+    for (;;) {
+        if (z < 0) {
+            z = -z;
+        } else if (z >= size) {
+            z = 2*(size - 1) - z;
+        } else {
+            return z;
+        }
+    }
+}
+
+}
+
+template <typename T>
+void Phf_snakes_volume<T>::read (boost::property_tree::ptree const& pt) {
+    pattern_           = pt.get<std::string>("image");
+    F_                 = pt.get<double>("F");
+    lambda_            = pt.get<double>("lambda");
+    sigma_             = pt.get<double>("sigma");
+    smoothing_         = pt.get<std::string>("smoothing", "auto");
+    C_s_               = pt.get<double>("C_s");
+    h_                 = pt.get<double>("h");
+    a_                 = pt.get<double>("a");
+    check_every_n_step_ = pt.get<int>("check_every_n_step");
+    tolerance_         = pt.get<double>("gauss-seidel.tolerance");
+    max_iterations_    = pt.get<int>("gauss-seidel.max_iterations");
+    png_options_.compression = pt.get<int>("png.compression", 1);
+    png_options_.filter = pt.get<std::string>("png.filter", "up");
+    first_             = pt.get<int>("volume.first", 0);
+    int last           = pt.get<int>("volume.last", -1);
+    std::string solver = pt.get<std::string>("solver", "gauss-seidel");
+    if (solver != "gauss-seidel")
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("volumes are solved by gauss-seidel, not " + solver));
+    if (pattern_.find('%') == std::string::npos)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("the image of a volume has to be a pattern such as images/ct-%03d, not " + pattern_));
+    if (first_ < 0 || (last >= 0 && last < first_ + 2))
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("volume of slices " + to_string(first_) + " to " + to_string(last)));
+    if (smoothing_ != "fir" && smoothing_ != "recursive" && smoothing_ != "auto")
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("smoothing " + smoothing_ + " is not fir, recursive or auto"));
+
+    std::vector<std::string> names;
+    for (int k = first_; last < 0 || k <= last; ++k) {
+        std::string name = boost::str(boost::format(pattern_) % k);
+        if (last < 0 && !std::ifstream((name + ".png").c_str())) {
+            break;
+        }
+        names.push_back(name);
+    }
+    if (names.size() < 3)
+        BOOST_THROW_EXCEPTION(parameter_error() << string_info("a volume needs at least 3 slices, " + pattern_ + " has " + to_string(names.size())));
+
+    std::string first_name = names[0];
+    std::string::size_type name_start = first_name.find_last_of('/');
+    name_start = (name_start == std::string::npos) ? 0 : name_start + 1;
+    output_path_ = prepare_output_directory(first_name.substr(name_start));
+    write_info(output_path_ + "phf-snakes.dat", pt);
+
+    Volume<double> P0;
+    field_t slice;
+    Field<T> contour;
+    for (std::size_t z = 0; z < names.size(); ++z) {
+        read_png(names[z] + ".png", slice);
+        if (z == 0) {
+            size_x_ = slice.size_x();
+            size_y_ = slice.size_y();
+            size_z_ = names.size();
+            P0.resize(size_x_, size_y_, size_z_);
+            p_.resize(size_x_, size_y_, size_z_);
+        }
+        if (slice.size_x() != size_x_ || slice.size_y() != size_y_)
+            throw size_mismatch_error();
+        P0.slice(z) = slice;
+        std::string contour_name = names[z] + (F_ >= 0.0 ? "-outer-contour.png" : "-inner-contour.png");
+        if (z == 0 || std::ifstream(contour_name.c_str())) {
+            read_png(contour_name, contour);
+            if (contour.size_x() != size_x_ || contour.size_y() != size_y_)
+                throw size_mismatch_error();
+        }
+        p_.slice(z) = contour;
+    }
+    for (int z = 0; z < size_z_; ++z) {
+        p_.slice(z).reflect_halo(0, size_y_);
+    }
+    p_.reflect_ghost_slices(0, size_z_);
+    p_old_ = p_;
+    gradp_.resize(size_x_, size_y_, size_z_);
+
+    xi_ = h_;
+    tau_ = xi_*xi_/a_;
+    smooth(P0);
+    compute_g(P0);
+}
+
+// Smooths P0 by the Gaussian in place: every slice as gaussian_smooth does,
+// then along z by the kernel of create_kernel with the slices mirrored at
+// the ends.
+template <typename T>
+void Phf_snakes_volume<T>::smooth (Volume<double>& P0) {
+    field_t smooth;
+    for (int z = 0; z < size_z_; ++z) {
+        gaussian_smooth(P0.slice(z), sigma_, h_, smooth, smoothing_);
+        P0.slice(z).swap(smooth);
+    }
+    std::vector<double> k = create_kernel(sigma_, h_);
+    int radius = k.size()/2;
+    if (radius == 0) {
+        return;
+    }
+    Volume<double> in;
+    in.resize(size_x_, size_y_, size_z_);
+    for (int z = 0; z < size_z_; ++z) {
+        in.slice(z) = P0.slice(z);
+    }
+#pragma omp parallel default(shared)
+    {
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+#else
+        int tid = 0;
+        int nthreads = 1;
+#endif
+        int z_start, z_end;
+        split_rows(size_z_, tid, nthreads, z_start, z_end);
+        for (int z = z_start; z < z_end; ++z) {
+            for (int y = 0; y < size_y_; ++y) {
+                double* r = P0.row(y, z);
+                std::fill(r, r + size_x_, 0.0);
+                for (int j = -radius; j <= radius; ++j) {
+                    double const* s = in.row(y, reflect(z + j, size_z_));
+                    double w = k[j + radius];
+                    for (int x = 0; x < size_x_; ++x) {
+                        r[x] += w*s[x];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Computes g of the norm of the gradient of the smoothed image, whose halo
+// is reflected, as compute_gh does in 2D with the differences in z added.
+template <typename T>
+void Phf_snakes_volume<T>::compute_g (Volume<double>& s) {
+    for (int z = 0; z < size_z_; ++z) {
+        s.slice(z).reflect_halo(0, size_y_);
+    }
+    s.reflect_ghost_slices(0, size_z_);
+    gh_.resize(size_x_, size_y_, size_z_);
+    gx_.resize(size_x_, size_y_, size_z_);
+    gy_.resize(size_x_, size_y_, size_z_);
+    gz_.resize(size_x_, size_y_, size_z_);
+    double h_inv = 1.0/h_;
+#pragma omp parallel default(shared)
+    {
+#ifdef _OPENMP
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+#else
+        int tid = 0;
+        int nthreads = 1;
+#endif
+        int z_start, z_end;
+        split_rows(size_z_, tid, nthreads, z_start, z_end);
+        for (int z = z_start; z < z_end; ++z) {
+            for (int y = 0; y < size_y_; ++y) {
+                double const* c = s.row(y, z);
+                double const* u = s.row(y+1, z);
+                double const* d = s.row(y-1, z);
+                double const* f = s.row(y, z+1);
+                double const* b = s.row(y, z-1);
+                T* r = gh_.row(y, z);
+                for (int x = 0; x < size_x_; ++x) {
+                    double dr = (c[x+1] - c[x])*h_inv;
+                    double dl = (c[x] - c[x-1])*h_inv;
+                    double du = (u[x] - c[x])*h_inv;
+                    double dd = (c[x] - d[x])*h_inv;
+                    double df = (f[x] - c[x])*h_inv;
+                    double db = (c[x] - b[x])*h_inv;
+                    r[x] = g(std::sqrt(0.5*(dr*dr + dl*dl + du*du + dd*dd + df*df + db*db)));
+                }
+            }
+        }
+#pragma omp barrier
+        for (int z = z_start; z < z_end; ++z) {
+            int zf = std::min(z + 1, size_z_ - 1);
+            for (int y = 0; y < size_y_; ++y) {
+                T const* c = gh_.row(y, z);
+                T const* u = gh_.row(std::min(y + 1, size_y_ - 1), z);
+                T const* f = gh_.row(y, zf);
+                T* rx = gx_.row(y, z);
+                T* ry = gy_.row(y, z);
+                T* rz = gz_.row(y, z);
+                for (int x = 0; x < size_x_ - 1; ++x) {
+                    rx[x] = (c[x] + c[x+1])/2.0;
+                }
+                rx[-1] = rx[0];
+                rx[size_x_-1] = rx[size_x_-2];
+                for (int x = 0; x < size_x_; ++x) {
+                    ry[x] = (c[x] + u[x])/2.0;
+                    rz[x] = (c[x] + f[x])/2.0;
+                }
+            }
+            // The faces at the end of the domain repeat the ones next to
+            // them, as in 2D.
+            std::copy(gy_.row(size_y_-2, z), gy_.row(size_y_-2, z) + size_x_, gy_.row(size_y_-1, z));
+            std::copy(gy_.row(0, z), gy_.row(0, z) + size_x_, gy_.row(-1, z));
+        }
+#pragma omp barrier
+#pragma omp single
+        {
+            gz_.copy_slice(size_z_ - 2, size_z_ - 1);
+            gz_.copy_slice(0, -1);
+        }
+    }
+}
+
+// Updates the slice z by Gauss-Seidel, row by row, and returns the largest
+// change. The halo of the slice and the ghost slice it mirrors are
+// refreshed afterwards.
+template <typename T>
+double Phf_snakes_volume<T>::relax_slice (int z) {
+    double tau_h = tau_/(h_*h_);
+    double tau_xi = tau_/(xi_*xi_);
+    double local_diff = 0.0;
+    Field<T>& p = p_.slice(z);
+    for (int y = 0; y < size_y_; ++y) {
+        T* pp = p.row(y);
+        T const* up = p_.row(y+1, z);
+        T const* down = p_.row(y-1, z);
+        T const* front = p_.row(y, z+1);
+        T const* back = p_.row(y, z-1);
+        T const* old = p_old_.row(y, z);
+        T const* gp = gradp_.row(y, z);
+        T const* gg = gh_.row(y, z);
+        T const* gx = gx_.row(y, z);
+        T const* gy_up = gy_.row(y, z);
+        T const* gy_down = gy_.row(y-1, z);
+        T const* gz_front = gz_.row(y, z);
+        T const* gz_back = gz_.row(y, z-1);
+        for (int x = 0; x < size_x_; ++x) {
+            if (x == size_x_ - 1) {
+                pp[size_x_] = pp[size_x_-2];
+            }
+            double c = pp[x];
+            double lg = gx[x-1], rg = gx[x];
+            double f0 = -a_*c*(c - 1)*(c - 0.5);
+            double sum = old[x] + tau_*gg[x]*F_*gp[x];
+            sum += tau_xi*gg[x]*f0;
+            sum += tau_h*(lg*pp[x-1] + rg*pp[x+1] + gy_down[x]*down[x] + gy_up[x]*up[x]
+                          + gz_back[x]*back[x] + gz_front[x]*front[x]);
+            sum /= 1.0 + tau_h*(lg + rg + gy_down[x] + gy_up[x] + gz_back[x] + gz_front[x]);
+            pp[x] = sum;
+            local_diff = std::max(local_diff, std::fabs(c - sum));
+        }
+        p.reflect_row_halo(y);
+        if (y == 1) {
+            std::copy(pp - 1, pp + size_x_ + 1, p.row(-1) - 1);
+        }
+        if (y == size_y_ - 2) {
+            std::copy(pp - 1, pp + size_x_ + 1, p.row(size_y_) - 1);
+        }
+    }
+    if (z == 1) {
+        p_.copy_slice(1, -1);
+    }
+    if (z == size_z_ - 2) {
+        p_.copy_slice(size_z_ - 2, size_z_);
+    }
+    return local_diff;
+}
+
+template <typename T>
+void Phf_snakes_volume<T>::solve () {
+    if (verbose) {
+        std::cout << "------------------------------------------------------------\n"
+                  << "volume       = " << pattern_ << ", " << size_x_ << "x" << size_y_ << "x" << size_z_ << " voxels\n"
+                  << "h            = " << h_ << "\n"
+                  << "a            = " << a_ << "\n"
+                  << "F            = " << F_ << "\n"
+                  << "C_s          = " << C_s_ << "\n"
+                  << "lambda       = " << lambda_ << "\n"
+                  << "sigma        = " << sigma_ << " (" << smoothing_ << " smoothing)\n"
+                  << "precision    = " << (sizeof(T) == sizeof(float) ? "float" : "double") << "\n"
+                  << "threads      = " << threads << "\n"
+                  << "------------------------------------------------------------" << std::endl;
+    }
+    diff_[0].assign(threads, 0.0);
+    diff_[1].assign(threads, 0.0);
+    solve_end_ = false;
+    steps_ = 0;
+    iterations_ = 0;
+    double start = wall_time();
+#pragma omp parallel default(shared) num_threads(threads)
+    {
+#ifdef _OPENMP
+        solve_thread(omp_get_thread_num(), omp_get_num_threads());
+#else
+        solve_thread(0, 1);
+#endif
+    }
+    if (verbose) {
+        std::cout << "\ngauss-seidel: " << steps_ << " time steps, " << iterations_ << " iterations ("
+                  << std::setprecision(3) << double(iterations_)/steps_ << " per step), "
+                  << wall_time() - start << " s" << std::endl;
+    }
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+    for (int z = 0; z < size_z_; ++z) {
+        write_png(output_path_ + "p-slice-" + to_string(first_ + z, 6) + ".png", p_.slice(z), png_options_);
+    }
+}
+
+template <typename T>
+void Phf_snakes_volume<T>::solve_thread (int tid, int nthreads) {
+    int z_start, z_end;
+    split_rows(size_z_, tid, nthreads, z_start, z_end);
+    double h_inv = 1.0/h_;
+    int nstep = 0;
+    do {
+        // p becomes p_old, and the norm of its gradient is computed once
+        // every thread has copied its slices.
+        for (int z = z_start; z < z_end; ++z) {
+            p_old_.slice(z) = p_.slice(z);
+        }
+        if (z_start == 0) {
+            p_old_.slice(-1) = p_.slice(-1);
+        }
+        if (z_end == size_z_) {
+            p_old_.slice(size_z_) = p_.slice(size_z_);
+        }
+#pragma omp barrier
+        for (int z = z_start; z < z_end; ++z) {
+            for (int y = 0; y < size_y_; ++y) {
+                T const* c = p_old_.row(y, z);
+                T const* u = p_old_.row(y+1, z);
+                T const* d = p_old_.row(y-1, z);
+                T const* f = p_old_.row(y, z+1);
+                T const* b = p_old_.row(y, z-1);
+                T* r = gradp_.row(y, z);
+                for (int x = 0; x < size_x_; ++x) {
+                    double dr = (c[x+1] - c[x])*h_inv;
+                    double dl = (c[x] - c[x-1])*h_inv;
+                    double du = (u[x] - c[x])*h_inv;
+                    double dd = (c[x] - d[x])*h_inv;
+                    double df = (f[x] - c[x])*h_inv;
+                    double db = (c[x] - b[x])*h_inv;
+                    r[x] = std::sqrt(0.5*(dr*dr + dl*dl + du*du + dd*dd + df*df + db*db));
+                }
+            }
+        }
+#pragma omp barrier
+        // The slices of one colour only read those of the other one, so
+        // the threads need to meet only after every half-sweep. The changes
+        // of consecutive iterations go to alternating arrays, so that they
+        // can be read after the barrier that ends the iteration while the
+        // next iteration writes.
+        int k = 0;
+        for (;;) {
+            double local_diff = 0.0;
+            for (int color = 0; color < 2; ++color) {
+                for (int z = z_start + (z_start + color) % 2; z < z_end; z += 2) {
+                    local_diff = std::max(local_diff, relax_slice(z));
+                }
+                if (color == 1) {
+                    diff_[k % 2][tid] = local_diff;
+                }
+#pragma omp barrier
+            }
+            ++k;
+            double global_diff = *std::max_element(diff_[(k - 1) % 2].begin(), diff_[(k - 1) % 2].end());
+            if (global_diff < tolerance_ || k >= max_iterations_) {
+                break;
+            }
+        }
+        ++nstep;
+#pragma omp single
+        {
+            ++steps_;
+            iterations_ += k;
+        }
+
+        if (nstep % check_every_n_step_ == 0) {
+            double sum = 0.0;
+            for (int z = z_start; z < z_end; ++z) {
+                for (int y = 0; y < size_y_; ++y) {
+                    T const* c = p_.row(y, z);
+                    T const* o = p_old_.row(y, z);
+                    for (int x = 0; x < size_x_; ++x) {
+                        sum += std::fabs(c[x] - o[x]);
+                    }
+                }
+            }
+            diff_[0][tid] = sum;
+#pragma omp barrier
+#pragma omp single
+            {
+                double total = 0.0;
+                for (int i = 0; i < nthreads; ++i) {
+                    total += diff_[0][i];
+                }
+                // The mean change per voxel scaled as the 2D test scales
+                // the mean change per pixel, so that C_s keeps its meaning.
+                double diff = total/(h_*h_*(size_x_ - 1)*(size_y_ - 1)*(size_z_ - 1));
+                solve_end_ = diff < C_s_*tau_;
+                if (verbose) {
+                    std::cout << "Time step: " << std::setw(5) << nstep
+                              << ", iterations: " << std::setw(5) << k
+                              << ", diff = " << std::setw(12) << std::setprecision(5) << diff
+                              << ", stop diff = " << std::setw(12) << std::setprecision(5) << C_s_*tau_
+                              << "\r";
+                    std::cout.flush();
+                }
+            }
+        }
+    } while (!solve_end_);
+}
+
+template class Phf_snakes_volume<float>;
+template class Phf_snakes_volume<double>;
@@ -0,0 +1,151 @@
+//
+//  Copyright (c) 2011-2012 Vladimir Chalupecky
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to
+//  deal in the Software without restriction, including without limitation the
+//  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+//  sell copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#ifndef __VOLUME_H_INCLUDED__
+#define __VOLUME_H_INCLUDED__ 
+
+#include "array.h"
+#include "image_io.h"
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// Three-dimensional field stored slice by slice, every slice a Field with its
+// own cache-aligned rows and halo. Ghost slices surround the volume so that
+// (x, y, z) is addressable for z in [-1, size_z] as well. A slice is the unit
+// of work of the solver: the threads own blocks of consecutive slices, and a
+// relaxation of a slice streams its rows and the same rows of the two
+// neighbouring slices, so every field is read once per half-sweep however
+// large the volume is.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Volume {
+public:
+    Volume()
+        : size_z_(0)
+    { }
+
+    void resize(int size_x, int size_y, int size_z) {
+        size_z_ = size_z;
+        slices_.resize(size_z + 2);
+        for (int z = 0; z < size_z + 2; ++z) {
+            slices_[z].resize(size_x, size_y);
+        }
+    }
+
+    int size_x() const { return slices_.empty() ? 0 : slices_[0].size_x(); }
+    int size_y() const { return slices_.empty() ? 0 : slices_[0].size_y(); }
+    int size_z() const { return size_z_; }
+
+    Field<T>&       slice(int z)       { return slices_[z + 1]; }
+    Field<T> const& slice(int z) const { return slices_[z + 1]; }
+
+    T*       row(int y, int z)       { return slice(z).row(y); }
+    T const* row(int y, int z) const { return slice(z).row(y); }
+
+    T&       operator() (int x, int y, int z)       { return row(y, z)[x]; }
+    T const& operator() (int x, int y, int z) const { return row(y, z)[x]; }
+
+    // Copies the slice from, including its halo, to the slice to.
+    void copy_slice(int from, int to) {
+        slice(to) = slice(from);
+    }
+
+    // Mirrors the slices next to the first and the last slice into the
+    // ghost slices if z_start or z_end is at the boundary.
+    void reflect_ghost_slices(int z_start, int z_end) {
+        if (z_start == 0) {
+            copy_slice(1, -1);
+        }
+        if (z_end == size_z_) {
+            copy_slice(size_z_ - 2, size_z_);
+        }
+    }
+
+private:
+    std::vector<Field<T> > slices_;
+    int size_z_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Segmentation of a volume by the three-dimensional model with the 7-point
+// stencil. The slices of the volume are PNG images whose names are given by
+// the pattern in the key image; every slice may have a contour file, which
+// otherwise is that of the slice before. The implicit system of a time step
+// is solved by red-black Gauss-Seidel over the slices: the threads own
+// blocks of slices, first update the even ones and then the odd ones, and
+// within a slice the voxels are updated in order. The result does not depend
+// on the number of threads. The stationary p is written slice by slice to
+// p-slice-<n>.png.
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+class Phf_snakes_volume {
+public:
+    Phf_snakes_volume ()
+        : threads(1), verbose(true)
+    { }
+
+    // Reads the parameters, the slices and their contours and prepares the
+    // output directory.
+    void read (boost::property_tree::ptree const& pt);
+    // Runs the time steps with a team of threads threads until p is
+    // stationary and writes it.
+    void solve ();
+
+    int threads;
+    bool verbose;
+
+private:
+    void smooth (Volume<double>& P0);
+    void compute_g (Volume<double>& P0_smooth);
+    void solve_thread (int tid, int nthreads);
+    double relax_slice (int z);
+    double g (double s) const {
+        return 1.0/(1.0 + lambda_*s*s);
+    }
+
+    double h_, a_, F_, lambda_, sigma_, C_s_, xi_, tau_;
+    std::string smoothing_;
+    double tolerance_;
+    int max_iterations_;
+    int check_every_n_step_;
+    std::string pattern_;
+    int first_;
+    std::string output_path_;
+    Png_options png_options_;
+
+    int size_x_, size_y_, size_z_;
+    // gx, gy and gz hold the values of g between the voxel and its neighbour
+    // in the direction of x, y or z, as gx and gy of Phf_snakes_data.
+    Volume<T> p_, p_old_, gradp_, gh_, gx_, gy_, gz_;
+
+    std::vector<double> diff_[2];
+    bool solve_end_;
+    int steps_;
+    long iterations_;
+};
+
+#endif /* __VOLUME_H_INCLUDED__ */